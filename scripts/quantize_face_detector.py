@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+"""Statically quantize the face detector to a QDQ model.
+
+Called by the face_calibrate tool, which dumps the pre-processed detector inputs of
+the configured video sources as raw float32 NCHW tensors. Activation ranges are
+collected from those tensors once with ONNX Runtime's calibrator; the same ranges are
+written to a JSON file and handed to the QDQ quantizer, which produces the model with
+per-channel INT8 weights.
+"""
+import argparse
+import json
+import os
+import tempfile
+from pathlib import Path
+
+import numpy as np
+import onnx
+from onnxruntime.quantization import CalibrationDataReader, CalibrationMethod, QuantType, create_calibrator
+from onnxruntime.quantization.qdq_quantizer import QDQQuantizer
+from onnxruntime.quantization.quant_utils import load_model_with_shape_infer
+from onnxruntime.quantization.registry import QDQRegistry, QLinearOpsRegistry
+from onnxruntime.quantization.shape_inference import quant_pre_process
+
+METHODS = {
+    "minmax": CalibrationMethod.MinMax,
+    "entropy": CalibrationMethod.Entropy,
+    "percentile": CalibrationMethod.Percentile,
+}
+
+
+class TensorFileReader(CalibrationDataReader):
+    """Feeds the dumped tensors to the calibrator one image at a time."""
+
+    def __init__(self, path, count, shape, input_name):
+        self.tensors = np.memmap(path, dtype=np.float32, mode="r", shape=(count, *shape))
+        self.input_name = input_name
+        self.index = 0
+
+    def get_next(self):
+        if self.index >= len(self.tensors):
+            return None
+        batch = np.ascontiguousarray(self.tensors[self.index:self.index + 1])
+        self.index += 1
+        return {self.input_name: batch}
+
+
+def tensor_ranges(data):
+    """Activation ranges of the calibrator's data as {tensor: [min, max]}, across ORT versions."""
+    items = data.data.items() if hasattr(data, "data") else data.items()
+    ranges = {}
+    for name, value in items:
+        if hasattr(value, "range_value"):
+            low, high = value.range_value
+        else:
+            low, high = value
+        ranges[name] = [float(np.asarray(low).min()), float(np.asarray(high).max())]
+    return ranges
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--model", required=True, help="FP32 detector")
+    parser.add_argument("--calibration", required=True, help="raw float32 tensors from face_calibrate")
+    parser.add_argument("--count", type=int, required=True, help="number of tensors in the calibration file")
+    parser.add_argument("--shape", default="3,640,640", help="C,H,W of one tensor")
+    parser.add_argument("--method", default="minmax", choices=sorted(METHODS))
+    parser.add_argument("--ranges", required=True, help="activation ranges JSON output")
+    parser.add_argument("--output", required=True, help="QDQ model output")
+    args = parser.parse_args()
+
+    shape = tuple(int(dim) for dim in args.shape.split(","))
+    input_name = onnx.load(args.model, load_external_data=False).graph.input[0].name
+
+    with tempfile.TemporaryDirectory() as work_dir:
+        prepared = os.path.join(work_dir, "prepared.onnx")
+        try:
+            quant_pre_process(args.model, prepared)
+        except ImportError:
+            # Symbolic shape inference needs sympy; ONNX shape inference is enough for a static detector
+            quant_pre_process(args.model, prepared, skip_symbolic_shape=True)
+
+        reader = TensorFileReader(args.calibration, args.count, shape, input_name)
+        calibrator = create_calibrator(prepared, augmented_model_path=os.path.join(work_dir, "augmented.onnx"),
+                                       calibrate_method=METHODS[args.method])
+        calibrator.collect_data(reader)
+        tensors_range = calibrator.compute_data()
+        ranges = tensor_ranges(tensors_range)
+        with open(args.ranges, "w") as ranges_file:
+            json.dump(ranges, ranges_file, indent=1, sort_keys=True)
+        print(f"(quantize) {len(ranges)} activation ranges -> {args.ranges}")
+
+        # What quantize_static() does after its own calibration, fed the ranges above instead
+        op_types = list(set(QLinearOpsRegistry) | set(QDQRegistry))
+        quantizer = QDQQuantizer(load_model_with_shape_infer(Path(prepared)),
+                                 True,  # per_channel
+                                 False,  # reduce_range
+                                 QuantType.QInt8,  # weights
+                                 QuantType.QUInt8,  # activations
+                                 tensors_range, [], [], op_types, {})
+        quantizer.quantize_model()
+        quantizer.model.save_model_to_file(args.output, False)
+
+    print(f"(quantize) QDQ model -> {args.output}")
+
+
+if __name__ == "__main__":
+    main()
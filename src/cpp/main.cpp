@@ -40,10 +40,18 @@
 #include "utils/input_source.h"
 #include "utils/vms.h"
 #include "utils/face_recognition.h"
+#include "utils/inference_service.h"
+#include "utils/face_batcher.h"
+#include "utils/shared_gallery.h"
+#include "utils/fifo_queue.h"
 
 constexpr int kMaxNumChannels = 100;
 constexpr int kFpsCountMax = 120;
 constexpr char kDefaultConfigPath[] = "assets/config.txt";
+constexpr char kDefaultFaceModelPath[] = "models/yolov8n-face_post.onnx";
+constexpr int kPipelineDepth = 3; // frames in flight per channel with inf_async: capture, inference, post-process
+constexpr std::chrono::milliseconds kFrameInterval(30); // ~33 FPS cap per channel
+constexpr size_t kGalleryIndexEfConstruction = 200;
 
 struct ChannelObject
 {
@@ -61,8 +69,12 @@ struct ChannelObject
 };
 
 // Global variables
+// Declared first so it is destroyed last: the channels' bindings and tensors refer to its sessions
+InferenceService g_inference_service; // ORT env and session pools shared by all channels
 ChannelObject g_chan_objs[kMaxNumChannels];
 VmsCfg g_config;
+std::unique_ptr<FaceBatcher> g_face_batcher; // cross-channel detector batching, null when inf_batch_size=1
+std::shared_ptr<SharedGallery> g_gallery;     // face database read by all channels, null without facenet=
 vector<InputSource *> g_input_sources;
 std::atomic<uint64_t> g_frame_count(0);
 int g_duration_in_secs = 5;
@@ -72,6 +84,24 @@ YOLOGuiView *g_gui = NULL;
 // Forward declarations
 float UpdatedFPS(int idx);
 
+// Detector model selected by dfp= / dfp_int8= / inf_precision= / dfp_raw= / inf_decode=
+std::string FaceModelPath()
+{
+    if (g_config.inf_decode == "raw")
+    {
+        if (!g_config.dfp_raw_file.empty())
+            return g_config.dfp_raw_file;
+        printf("inf_decode=raw but no dfp_raw model configured, using the post-processed model\n");
+    }
+    if (g_config.inf_precision == "int8")
+    {
+        if (!g_config.dfp_int8_file.empty())
+            return g_config.dfp_int8_file;
+        printf("inf_precision=int8 but no dfp_int8 model configured, using the fp32 model\n");
+    }
+    return g_config.dfp_file.empty() ? kDefaultFaceModelPath : g_config.dfp_file;
+}
+
 void signalHandler(int /*pSignal*/)
 {
     g_is_running = false;
@@ -87,6 +117,9 @@ void ProcessChannel(int channel_idx)
     auto &screen = chan_obj.screen;
     auto face_recognition_handle = chan_obj.face_recognition_handle.get();
 
+    // Refilled every frame; keeping it here lets its buffers be reused instead of reallocated
+    FaceRecognitionResult result;
+
     while (g_is_running) {
         // Compute letterbox padding for face recognition model
         face_recognition_handle->ComputePadding(chan_obj.disp_width, chan_obj.disp_height);
@@ -98,7 +131,6 @@ void ProcessChannel(int channel_idx)
         input_source->GetFrame(*disp_frame);
 
         // Run face recognition processing
-        FaceRecognitionResult result;
         float confidence = (screen->GetConfidenceValue() == -1.0) ? g_config.inf_confidence : screen->GetConfidenceValue();
         face_recognition_handle->SetConfidenceThreshold(confidence);
         face_recognition_handle->ProcessImage(disp_frame->data, chan_obj.disp_width, chan_obj.disp_height, result);
@@ -111,8 +143,96 @@ void ProcessChannel(int channel_idx)
         screen->SetDisplayFrame(channel_idx, disp_frame, fps_number);
 
         // Sleep briefly to avoid overwhelming the CPU
-        std::this_thread::sleep_for(std::chrono::milliseconds(30)); // ~33 FPS
+        std::this_thread::sleep_for(kFrameInterval); // ~33 FPS
+    }
+}
+
+struct PipelineFrame
+{
+    cv::Mat *disp_frame; // nullptr ends the pipeline
+    size_t slot;         // detector input/output slot holding this frame
+    bool detect;         // false when the tracker propagates the faces instead
+};
+
+// Asynchronous processing for inf_async=1: capture + pre-process, inference, and
+// post-process + draw run on their own threads connected by FIFOs, so frame N+1 is
+// prepared and frame N-1 drawn while frame N is in the model. Every stage takes frames
+// in arrival order, so the channel's frame order is preserved. Frames the tracker
+// propagates skip pre-processing and inference but still flow through the stages.
+void ProcessChannelPipelined(int channel_idx)
+{
+    auto &chan_obj = g_chan_objs[channel_idx];
+    auto &input_source = chan_obj.input_source;
+    auto &screen = chan_obj.screen;
+    auto face_recognition_handle = chan_obj.face_recognition_handle.get();
+
+    mxutil_fifo_queue<size_t> free_slots;
+    mxutil_fifo_queue<PipelineFrame> infer_queue;
+    mxutil_fifo_queue<PipelineFrame> post_queue;
+    for (size_t slot = 0; slot < face_recognition_handle->NumSlots(); slot++)
+        free_slots.push(slot);
+
+    // The viewer size is fixed, so the letterbox geometry is set once instead of by every frame
+    face_recognition_handle->ComputePadding(chan_obj.disp_width, chan_obj.disp_height);
+
+    std::thread inference_thread([&]() {
+        while (true)
+        {
+            PipelineFrame frame = infer_queue.pop();
+            if (frame.disp_frame && frame.detect)
+                face_recognition_handle->Infer(frame.slot);
+            post_queue.push(frame);
+            if (!frame.disp_frame)
+                return;
+        }
+    });
+
+    std::thread post_thread([&]() {
+        FaceRecognitionResult result;
+        while (true)
+        {
+            PipelineFrame frame = post_queue.pop();
+            if (!frame.disp_frame)
+                return;
+
+            if (frame.detect)
+                face_recognition_handle->PostProcess(frame.slot, result);
+            free_slots.push(frame.slot);
+
+            face_recognition_handle->Track(result, frame.detect);
+
+            face_recognition_handle->Recognize(frame.disp_frame->data, chan_obj.disp_width, chan_obj.disp_height, result);
+            face_recognition_handle->DrawResult(result, *frame.disp_frame);
+
+            float fps_number = UpdatedFPS(channel_idx);
+            screen->SetDisplayFrame(channel_idx, frame.disp_frame, fps_number);
+        }
+    });
+
+    auto next_frame_time = std::chrono::steady_clock::now();
+    while (g_is_running)
+    {
+        size_t slot = free_slots.pop();
+
+        cv::Mat *disp_frame = screen->GetDisplayFrameBuf(channel_idx);
+        input_source->GetFrame(*disp_frame);
+
+        float confidence = (screen->GetConfidenceValue() == -1.0) ? g_config.inf_confidence : screen->GetConfidenceValue();
+        face_recognition_handle->SetConfidenceThreshold(confidence);
+        bool detect = face_recognition_handle->ShouldDetect(disp_frame->data, chan_obj.disp_width, chan_obj.disp_height);
+        if (detect)
+            face_recognition_handle->PreProcess(disp_frame->data, chan_obj.disp_width, chan_obj.disp_height,
+                                                face_recognition_handle->InputTensor(slot));
+        infer_queue.push({disp_frame, slot, detect});
+
+        // Same frame cap as the sequential loop, but the wait overlaps the other stages
+        next_frame_time = std::max(next_frame_time + kFrameInterval, std::chrono::steady_clock::now());
+        std::this_thread::sleep_until(next_frame_time);
     }
+
+    infer_queue.push({nullptr, 0, false});
+    inference_thread.join();
+    post_thread.join();
 }
 
 float CalculateFPS(ChannelObject &channel)
@@ -215,6 +335,20 @@ void InfoWatcher(int monitoring_duration_seconds)
                 uint64_t diff_count = g_frame_count - prev_frame_count;
                 prev_frame_count = g_frame_count;
                 printf("%d: FPS %.1f | CPU_load %.1f %%\n", idx_print++, (float)diff_count / monitoring_duration_seconds, cpu_load);
+
+                // Detector runs versus frames the motion gate skipped, since start
+                if (g_config.motion_gate)
+                {
+                    printf("   motion gate (detected/gated):");
+                    for (int ch = 0; ch < g_config.num_chs; ch++)
+                    {
+                        const auto &handle = g_chan_objs[ch].face_recognition_handle;
+                        if (handle)
+                            printf(" ch%d %llu/%llu", ch, (unsigned long long)handle->UngatedFrames(),
+                                   (unsigned long long)handle->GatedFrames());
+                    }
+                    printf("\n");
+                }
             }
             run_count = 0;
         }
@@ -232,6 +366,20 @@ void InitScreen(YOLOGuiView &gui, int screen_idx)
     g_gui = &gui;
 }
 
+void InitGallery()
+{
+    // One gallery for every channel, opened and indexed once
+    g_gallery = std::make_shared<SharedGallery>();
+    if (!g_config.fr_gallery.empty() && !g_gallery->Open(g_config.fr_gallery))
+        std::cerr << "Cannot open gallery " << g_config.fr_gallery << ", starting with an empty face database" << std::endl;
+    g_gallery->Update([](FaceDatabase &database) {
+        if (g_config.fr_index)
+            database.enable_index(g_config.fr_index_m, kGalleryIndexEfConstruction, g_config.fr_index_ef);
+        if (g_config.fr_int8)
+            database.enable_quantization();
+    });
+}
+
 void InitChannelObjects(YOLOGuiView &gui, int idx)
 {
     // Initialize face recognition with standard input size
@@ -239,6 +387,17 @@ void InitChannelObjects(YOLOGuiView &gui, int idx)
     int model_input_height = 640;
     int model_input_channel = 3;
 
+    // All channels borrow from the same detector sessions
+    SessionPool &detector_pool = g_inference_service.GetPool(FaceModelPath());
+    // Raw-head models have several outputs, which the batcher does not split per image
+    bool raw_heads = g_config.inf_decode == "raw" && !g_config.dfp_raw_file.empty();
+    if (g_config.inf_batch_size > 1 && !raw_heads && !g_face_batcher)
+    {
+        g_face_batcher = std::make_unique<FaceBatcher>(detector_pool, g_config.inf_batch_size, g_config.inf_batch_timeout_ms);
+    }
+    if (g_face_batcher)
+        g_face_batcher->RegisterClient();
+
     auto screen = gui.screens.at(g_config.screen_idx).get();
     g_chan_objs[idx].screen = screen;
     g_chan_objs[idx].disp_width = screen->GetViewerWidth(idx);
@@ -246,8 +405,26 @@ void InitChannelObjects(YOLOGuiView &gui, int idx)
     g_chan_objs[idx].frame_count = 0;
     g_chan_objs[idx].input_source = g_input_sources.at(idx);
     g_chan_objs[idx].face_recognition_handle = std::make_unique<FaceRecognition>(
-        model_input_width, model_input_height, model_input_channel,
-        g_config.inf_confidence);
+        detector_pool, model_input_width, model_input_height, model_input_channel,
+        g_config.inf_confidence, g_face_batcher.get(), g_config.inf_async ? kPipelineDepth : 1);
+
+    // Embedding sessions are shared the same way; each channel batches its own faces
+    if (!g_config.facenet_file.empty())
+    {
+        g_chan_objs[idx].face_recognition_handle->EnableRecognition(
+            g_inference_service.GetPool(g_config.facenet_file), g_config.fr_threshold, g_config.fr_min_quality);
+        g_chan_objs[idx].face_recognition_handle->UseGallery(g_gallery);
+    }
+
+    if (g_config.track)
+    {
+        g_chan_objs[idx].face_recognition_handle->EnableTracking(g_config.track_interval, g_config.fr_cold_interval);
+    }
+
+    if (g_config.motion_gate)
+    {
+        g_chan_objs[idx].face_recognition_handle->EnableMotionGate(g_config.motion_heartbeat, g_config.motion_threshold);
+    }
 }
 
 // No buffer allocation needed for CPU-only processing
@@ -290,6 +467,10 @@ int main(int argc, char *argv[])
     // Parse command-line arguments
     ParseArgs(argc, argv);
 
+    // Create the process-wide ORT environment before any channel loads a model
+    g_inference_service.Init(g_config.inf_threads, g_config.inf_sessions,
+                             g_config.ort_cache ? g_config.ort_cache_dir : "");
+
     // Initialize GUI and specify the screen for display
     YOLOGuiView gui(argc, argv);
     InitScreen(gui, g_config.screen_idx);
@@ -298,6 +479,9 @@ int main(int argc, char *argv[])
     // Initialize input capture sources
     InitCaps(screen, g_config, g_input_sources);
 
+    if (!g_config.facenet_file.empty())
+        InitGallery();
+
     // Initialize channel objects with face recognition
     std::vector<std::thread> processing_threads;
     for (uint32_t channel_idx = 0; channel_idx < screen->NumViewers(); channel_idx++)
@@ -305,7 +489,7 @@ int main(int argc, char *argv[])
         InitChannelObjects(gui, channel_idx);
 
         // Start a processing thread for each channel
-        processing_threads.emplace_back(ProcessChannel, channel_idx);
+        processing_threads.emplace_back(g_config.inf_async ? ProcessChannelPipelined : ProcessChannel, channel_idx);
     }
 
     printf("Started %d processing threads for face recognition\n", (int)processing_threads.size());
@@ -331,6 +515,13 @@ int main(int argc, char *argv[])
 
     info_watcher.join();
 
+    // Release the channels' bindings and tensors while the sessions and the allocator are alive,
+    // then stop the batch workers once no channel can submit anymore
+    for (auto &chan_obj : g_chan_objs)
+        chan_obj.face_recognition_handle.reset();
+    g_gallery.reset();
+    g_face_batcher.reset();
+
     // Cleanup allocated resources
     Clean();
 
@@ -0,0 +1,311 @@
+/*
+ * face_calibrate: build a statically quantized (QDQ, INT8) face detector from the
+ * video sources of a VMS config, and measure what the quantization costs.
+ *
+ *   1. Replay every video= source, sampling frames through FaceRecognition::PreProcess,
+ *      and store the detector input tensors as calibration data. The FP32 detections
+ *      of those frames are kept as the reference.
+ *   2. Run scripts/quantize_face_detector.py, which collects per-tensor activation
+ *      ranges with ONNX Runtime's calibrator and writes the QDQ model.
+ *   3. Run the FP32 and INT8 detectors on the same tensors and report AP@0.5 of the
+ *      INT8 detections against the FP32 reference, plus the inference latency of both.
+ */
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <opencv2/opencv.hpp>
+
+#include "utils/vms.h"
+#include "utils/inference_service.h"
+#include "utils/face_recognition.h"
+
+constexpr char kDefaultConfigPath[] = "assets/config.txt";
+constexpr char kDefaultFaceModelPath[] = "models/yolov8n-face_post.onnx";
+constexpr char kQuantizeScript[] = "scripts/quantize_face_detector.py";
+constexpr int kModelInputSize = 640;
+constexpr float kEvalConfidence = 0.05f; // INT8 detections are ranked down to this score for AP
+constexpr float kMatchIoU = 0.5f;
+
+struct CalibOptions
+{
+    std::string config_path = kDefaultConfigPath;
+    std::string output_path;
+    std::string method = "minmax";
+    int frames_per_source = 64;
+    int frame_stride = 10;
+};
+
+struct ScoredBox
+{
+    int frame_idx;
+    FaceBox box;
+};
+
+static float BoxIoU(const FaceBox &a, const FaceBox &b)
+{
+    float x1 = std::max(a.x_min, b.x_min);
+    float y1 = std::max(a.y_min, b.y_min);
+    float x2 = std::min(a.x_max, b.x_max);
+    float y2 = std::min(a.y_max, b.y_max);
+    if (x2 <= x1 || y2 <= y1)
+        return 0.0f;
+
+    float intersection = (x2 - x1) * (y2 - y1);
+    float union_area = (a.x_max - a.x_min) * (a.y_max - a.y_min) + (b.x_max - b.x_min) * (b.y_max - b.y_min) - intersection;
+    return union_area > 0 ? intersection / union_area : 0.0f;
+}
+
+// Run a program with exactly these arguments (no shell, so paths are never split or interpreted);
+// returns its exit status, or -1 if it could not run or was killed
+static int RunProgram(const std::vector<std::string> &args)
+{
+    std::vector<char *> argv;
+    for (const std::string &arg : args)
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0)
+    {
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+            return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// All-point interpolated AP of the candidate detections against the reference boxes
+static double AveragePrecision(std::vector<ScoredBox> candidates, const std::vector<std::vector<FaceBox>> &references)
+{
+    size_t num_references = 0;
+    std::vector<std::vector<bool>> matched(references.size());
+    for (size_t i = 0; i < references.size(); i++)
+    {
+        num_references += references[i].size();
+        matched[i].assign(references[i].size(), false);
+    }
+    if (num_references == 0)
+        return candidates.empty() ? 1.0 : 0.0;
+
+    std::sort(candidates.begin(), candidates.end(),
+              [](const ScoredBox &a, const ScoredBox &b) { return a.box.confidence > b.box.confidence; });
+
+    std::vector<double> precision, recall;
+    size_t true_positives = 0;
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        const auto &refs = references[candidates[i].frame_idx];
+        int best = -1;
+        float best_iou = kMatchIoU;
+        for (size_t r = 0; r < refs.size(); r++)
+        {
+            float iou = BoxIoU(candidates[i].box, refs[r]);
+            if (!matched[candidates[i].frame_idx][r] && iou >= best_iou)
+            {
+                best_iou = iou;
+                best = r;
+            }
+        }
+        if (best >= 0)
+        {
+            matched[candidates[i].frame_idx][best] = true;
+            true_positives++;
+        }
+        precision.push_back(static_cast<double>(true_positives) / (i + 1));
+        recall.push_back(static_cast<double>(true_positives) / num_references);
+    }
+
+    // Make precision monotonically decreasing, then integrate over recall
+    for (int i = static_cast<int>(precision.size()) - 2; i >= 0; i--)
+        precision[i] = std::max(precision[i], precision[i + 1]);
+
+    double ap = 0.0, prev_recall = 0.0;
+    for (size_t i = 0; i < precision.size(); i++)
+    {
+        ap += (recall[i] - prev_recall) * precision[i];
+        prev_recall = recall[i];
+    }
+    return ap;
+}
+
+static void ParseArgs(int argc, char *argv[], CalibOptions &options)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "c:o:m:n:s:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            options.config_path = optarg;
+            break;
+        case 'o':
+            options.output_path = optarg;
+            break;
+        case 'm':
+            options.method = optarg;
+            break;
+        case 'n':
+            options.frames_per_source = std::stoi(optarg);
+            break;
+        case 's':
+            options.frame_stride = std::max(1, std::stoi(optarg));
+            break;
+        case 'h':
+        default:
+            printf("-c: config file with video= sources,\t\tdefault: %s\n", kDefaultConfigPath);
+            printf("-o: quantized model output path,\t\tdefault: <dfp>.qdq.onnx\n");
+            printf("-m: calibration method (minmax|entropy|percentile),\tdefault: minmax\n");
+            printf("-n: calibration frames per video source,\tdefault: 64\n");
+            printf("-s: use every n-th frame of each video,\t\tdefault: 10\n");
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    CalibOptions options;
+    ParseArgs(argc, argv, options);
+
+    VmsCfg config;
+    ReadVmsConfigFromFile(options.config_path.c_str(), config);
+
+    const std::string fp32_path = config.dfp_file.empty() ? kDefaultFaceModelPath : config.dfp_file;
+    if (options.output_path.empty())
+    {
+        std::string stem = fp32_path.substr(0, fp32_path.rfind(".onnx"));
+        options.output_path = stem + ".qdq.onnx";
+    }
+    const std::string calib_path = options.output_path + ".calib.bin";
+    const std::string ranges_path = options.output_path + ".ranges.json";
+
+    InferenceService inference_service;
+    inference_service.Init(config.inf_threads, 1, config.ort_cache ? config.ort_cache_dir : "");
+
+    FaceRecognition fp32_detector(inference_service.GetPool(fp32_path),
+                                  kModelInputSize, kModelInputSize, 3, config.inf_confidence);
+    const size_t tensor_size = kModelInputSize * kModelInputSize * 3;
+
+    // 1. Replay the video sources through the production pre-processing
+    std::ofstream calib_file(calib_path, std::ios::binary);
+    std::vector<std::vector<FaceBox>> references;
+    for (const auto &source : config.video_inputs)
+    {
+        if (source.type != VIDEO_FROM_FILE)
+            continue;
+
+        cv::VideoCapture capture(source.access_value);
+        if (!capture.isOpened())
+        {
+            printf("cannot open video %s, skipped\n", source.access_value.c_str());
+            continue;
+        }
+
+        cv::Mat bgr_frame, rgb_frame;
+        int frame_idx = 0, sampled = 0;
+        while (sampled < options.frames_per_source && capture.read(bgr_frame))
+        {
+            if (frame_idx++ % options.frame_stride != 0)
+                continue;
+
+            cv::cvtColor(bgr_frame, rgb_frame, cv::COLOR_BGR2RGB);
+            fp32_detector.ComputePadding(rgb_frame.cols, rgb_frame.rows);
+            fp32_detector.PreProcess(rgb_frame.data, rgb_frame.cols, rgb_frame.rows, fp32_detector.InputTensor());
+            calib_file.write(reinterpret_cast<const char *>(fp32_detector.InputTensor()), tensor_size * sizeof(float));
+
+            FaceRecognitionResult result;
+            fp32_detector.RunDetector(result);
+            references.emplace_back();
+            for (int i = 0; i < result.num_faces; i++)
+                references.back().push_back(result.face(i));
+            sampled++;
+        }
+        printf("(calibrate) %s: %d frames\n", source.access_value.c_str(), sampled);
+    }
+    calib_file.close();
+
+    if (references.empty())
+    {
+        printf("no calibration frames, check the video= entries of %s\n", options.config_path.c_str());
+        return EXIT_FAILURE;
+    }
+
+    // 2. Collect activation ranges and write the QDQ model
+    const std::vector<std::string> command = {
+        "python3", kQuantizeScript,
+        "--model", fp32_path,
+        "--calibration", calib_path,
+        "--count", std::to_string(references.size()),
+        "--shape", "3," + std::to_string(kModelInputSize) + "," + std::to_string(kModelInputSize),
+        "--method", options.method,
+        "--ranges", ranges_path,
+        "--output", options.output_path};
+    printf("(calibrate)");
+    for (const std::string &arg : command)
+        printf(" %s", arg.c_str());
+    printf("\n");
+    if (RunProgram(command) != 0)
+    {
+        printf("quantization failed\n");
+        return EXIT_FAILURE;
+    }
+
+    // 3. Compare INT8 against FP32 on the same tensors
+    FaceRecognition int8_detector(inference_service.GetPool(options.output_path),
+                                  kModelInputSize, kModelInputSize, 3, kEvalConfidence);
+    std::ifstream tensors(calib_path, std::ios::binary);
+    std::vector<ScoredBox> candidates;
+    double fp32_ms = 0.0, int8_ms = 0.0;
+    size_t int8_faces = 0, fp32_faces = 0;
+    FaceRecognitionResult result;
+    for (size_t frame = 0; frame < references.size(); frame++)
+    {
+        tensors.read(reinterpret_cast<char *>(int8_detector.InputTensor()), tensor_size * sizeof(float));
+        std::copy(int8_detector.InputTensor(), int8_detector.InputTensor() + tensor_size, fp32_detector.InputTensor());
+
+        // Only inference is timed: the INT8 detector decodes down to kEvalConfidence, so its
+        // post-processing sees far more candidates than the FP32 one at inf_confidence
+        auto start = std::chrono::steady_clock::now();
+        fp32_detector.Infer(0);
+        auto mid = std::chrono::steady_clock::now();
+        int8_detector.Infer(0);
+        auto end = std::chrono::steady_clock::now();
+        int8_detector.PostProcess(0, result);
+
+        fp32_ms += std::chrono::duration<double, std::milli>(mid - start).count();
+        int8_ms += std::chrono::duration<double, std::milli>(end - mid).count();
+        fp32_faces += references[frame].size();
+
+        for (int i = 0; i < result.num_faces; i++)
+        {
+            candidates.push_back({static_cast<int>(frame), result.face(i)});
+            if (result.confidence[i] >= config.inf_confidence)
+                int8_faces++;
+        }
+    }
+
+    double ap = AveragePrecision(candidates, references);
+    size_t num_frames = references.size();
+    printf("\n==== face_calibrate report (%zu frames, %s calibration) ====\n", num_frames, options.method.c_str());
+    printf("model            : %s -> %s\n", fp32_path.c_str(), options.output_path.c_str());
+    printf("activation ranges: %s\n", ranges_path.c_str());
+    printf("faces @ conf %.2f : fp32 %zu | int8 %zu\n", config.inf_confidence, fp32_faces, int8_faces);
+    printf("AP@0.5 vs fp32   : fp32 1.0000 | int8 %.4f | delta %.4f\n", ap, ap - 1.0);
+    printf("inference / frame: fp32 %.2f ms | int8 %.2f ms | speedup %.2fx\n",
+           fp32_ms / num_frames, int8_ms / num_frames, int8_ms > 0 ? fp32_ms / int8_ms : 0.0);
+    printf("enable with: dfp_int8=%s and inf_precision=int8\n", options.output_path.c_str());
+
+    return 0;
+}
@@ -0,0 +1,326 @@
+/*
+ * gallery_bench: recall vs. latency of the gallery search modes against the exact scan.
+ *
+ *   1. Enroll a gallery, either synthetic (random unit vectors) or real embeddings read
+ *      from a raw float32 file (-f, one row of -d floats per template).
+ *   2. Enable the int8 scan, then build the HNSW index and time the build.
+ *   3. Query with noisy copies of enrolled templates (synthetic), or with rows held out of
+ *      the file (real), and report for the exact scan, the batched exact scan (-b queries
+ *      per call, latency per query), the int8 scan with float re-ranking, single and
+ *      batched, and every efSearch value: mean and p99 latency, recall@1 and recall@k of
+ *      the identities against the exact scan.
+ *   4. Put the first -w identities on the watchlist and time the watchlist tier alone,
+ *      which should not depend on the size of the gallery.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "utils/face_database.h"
+
+struct BenchOptions
+{
+    std::string embeddings_path; // empty = synthetic
+    size_t num_templates = 100000;
+    size_t templates_per_identity = 1;
+    size_t dimension = 128;
+    size_t num_queries = 1000;
+    size_t k = 10;
+    size_t m = 16;
+    size_t ef_construction = 200;
+    size_t rerank = 64;
+    size_t batch = 16; // queries per search_batch() call, like the faces of a busy frame
+    size_t watchlist = 500;
+    std::vector<size_t> ef_search = {16, 32, 64, 128, 256};
+    float noise = 0.5f; // query noise relative to a template's norm, synthetic only
+};
+
+struct Latency
+{
+    double mean_ms;
+    double p99_ms;
+};
+
+static Latency Summarize(std::vector<double> &times_ms)
+{
+    std::sort(times_ms.begin(), times_ms.end());
+    double total = 0.0;
+    for (double t : times_ms)
+        total += t;
+    return {total / times_ms.size(), times_ms[std::min(times_ms.size() - 1, times_ms.size() * 99 / 100)]};
+}
+
+static std::vector<size_t> ParseList(const char *text)
+{
+    std::vector<size_t> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ','))
+        values.push_back(std::stoul(item));
+    return values;
+}
+
+static void ParseArgs(int argc, char *argv[], BenchOptions &options)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "f:n:t:d:q:k:m:c:e:r:b:w:s:h")) != -1)
+    {
+        switch (opt)
+        {
+        case 'f':
+            options.embeddings_path = optarg;
+            break;
+        case 'n':
+            options.num_templates = std::stoul(optarg);
+            break;
+        case 't':
+            options.templates_per_identity = std::max<size_t>(1, std::stoul(optarg));
+            break;
+        case 'd':
+            options.dimension = std::stoul(optarg);
+            break;
+        case 'q':
+            options.num_queries = std::stoul(optarg);
+            break;
+        case 'k':
+            options.k = std::max<size_t>(1, std::stoul(optarg));
+            break;
+        case 'm':
+            options.m = std::stoul(optarg);
+            break;
+        case 'c':
+            options.ef_construction = std::stoul(optarg);
+            break;
+        case 'e':
+            options.ef_search = ParseList(optarg);
+            break;
+        case 'r':
+            options.rerank = std::max<size_t>(1, std::stoul(optarg));
+            break;
+        case 'b':
+            options.batch = std::max<size_t>(1, std::stoul(optarg));
+            break;
+        case 'w':
+            options.watchlist = std::stoul(optarg);
+            break;
+        case 's':
+            options.noise = std::stof(optarg);
+            break;
+        case 'h':
+        default:
+            printf("-f: raw float32 embeddings (rows of -d floats),\tdefault: synthetic\n");
+            printf("-n: templates enrolled,\t\t\t\tdefault: 100000\n");
+            printf("-t: templates per identity,\t\t\tdefault: 1\n");
+            printf("-d: embedding size,\t\t\t\tdefault: 128\n");
+            printf("-q: queries,\t\t\t\t\tdefault: 1000\n");
+            printf("-k: identities compared for recall@k,\t\tdefault: 10\n");
+            printf("-m: HNSW links per node (M),\t\t\tdefault: 16\n");
+            printf("-c: HNSW efConstruction,\t\t\tdefault: 200\n");
+            printf("-e: efSearch values, comma separated,\t\tdefault: 16,32,64,128,256\n");
+            printf("-r: int8 scan candidates re-ranked in float,\tdefault: 64\n");
+            printf("-b: queries per batched search,\t\tdefault: 16\n");
+            printf("-w: watchlist identities,\t\t\tdefault: 500\n");
+            printf("-s: synthetic query noise,\t\t\tdefault: 0.5\n");
+            exit(1);
+        }
+    }
+    if (options.ef_search.empty() || std::count(options.ef_search.begin(), options.ef_search.end(), 0))
+    {
+        fprintf(stderr, "-e needs a comma separated list of efSearch values above 0\n");
+        exit(1);
+    }
+}
+
+// Gallery rows followed by query rows
+static bool LoadEmbeddings(const BenchOptions &options, std::vector<float> &gallery, std::vector<float> &queries)
+{
+    const size_t dim = options.dimension;
+    std::mt19937 rng(42);
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+
+    if (!options.embeddings_path.empty())
+    {
+        std::ifstream file(options.embeddings_path, std::ios::binary | std::ios::ate);
+        if (!file)
+        {
+            fprintf(stderr, "cannot open %s\n", options.embeddings_path.c_str());
+            return false;
+        }
+        const size_t rows = static_cast<size_t>(file.tellg()) / (dim * sizeof(float));
+        if (rows <= options.num_queries)
+        {
+            fprintf(stderr, "%s holds %zu rows of %zu floats, need more than %zu\n",
+                    options.embeddings_path.c_str(), rows, dim, options.num_queries);
+            return false;
+        }
+        const size_t num_gallery = std::min(options.num_templates, rows - options.num_queries);
+        gallery.resize(num_gallery * dim);
+        queries.resize(options.num_queries * dim);
+        file.seekg(0);
+        file.read(reinterpret_cast<char *>(gallery.data()), gallery.size() * sizeof(float));
+        file.read(reinterpret_cast<char *>(queries.data()), queries.size() * sizeof(float));
+        return static_cast<bool>(file);
+    }
+
+    gallery.resize(options.num_templates * dim);
+    for (float &value : gallery)
+        value = normal(rng);
+
+    // Queries: a random enrolled template plus noise of the given relative norm
+    queries.resize(options.num_queries * dim);
+    const float noise_scale = options.noise / std::sqrt(static_cast<float>(dim));
+    for (size_t q = 0; q < options.num_queries; q++)
+    {
+        const float *source = gallery.data() + (rng() % options.num_templates) * dim;
+        float norm = 0.0f;
+        for (size_t d = 0; d < dim; d++)
+            norm += source[d] * source[d];
+        norm = std::sqrt(norm);
+        for (size_t d = 0; d < dim; d++)
+            queries[q * dim + d] = source[d] / norm + noise_scale * normal(rng);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+    ParseArgs(argc, argv, options);
+
+    std::vector<float> gallery, queries;
+    if (!LoadEmbeddings(options, gallery, queries))
+        return 1;
+    const size_t dim = options.dimension;
+    const size_t num_templates = gallery.size() / dim;
+    const size_t num_queries = queries.size() / dim;
+
+    FaceDatabase database;
+    int identity = -1;
+    for (size_t row = 0; row < num_templates; row++)
+    {
+        if (row % options.templates_per_identity == 0)
+            identity = database.add_identity("id" + std::to_string(row / options.templates_per_identity));
+        database.add_embedding_to_identity(identity, std::vector<float>(gallery.begin() + row * dim,
+                                                                        gallery.begin() + (row + 1) * dim));
+    }
+    printf("gallery: %zu templates, %zu identities, %zu floats each (%s)\n", database.num_templates(),
+           database.size(), dim, options.embeddings_path.empty() ? "synthetic" : options.embeddings_path.c_str());
+
+    // Exact scan as the reference
+    const size_t k = options.k;
+    std::vector<GalleryHit> exact(num_queries * k);
+    std::vector<size_t> exact_count(num_queries);
+    std::vector<double> times_ms(num_queries);
+    for (size_t q = 0; q < num_queries; q++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        exact_count[q] = database.search_exact(queries.data() + q * dim, dim, k, exact.data() + q * k);
+        times_ms[q] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    Latency latency = Summarize(times_ms);
+    printf("%-10s %10s %10s %10s %10s\n", "search", "mean ms", "p99 ms", "recall@1", "recall@k");
+    printf("%-10s %10.3f %10.3f %10.4f %10.4f\n", "exact", latency.mean_ms, latency.p99_ms, 1.0, 1.0);
+
+    // Recall of one query's hits against the reference
+    size_t top1 = 0, found = 0, wanted = 0;
+    auto score = [&](size_t q, const GalleryHit *hits, size_t count) {
+        const GalleryHit *reference = exact.data() + q * k;
+        if (count > 0 && exact_count[q] > 0 && hits[0].identity_id == reference[0].identity_id)
+            top1++;
+        for (size_t i = 0; i < exact_count[q]; i++)
+        {
+            wanted++;
+            for (size_t j = 0; j < count; j++)
+            {
+                if (hits[j].identity_id == reference[i].identity_id)
+                {
+                    found++;
+                    break;
+                }
+            }
+        }
+    };
+    auto report = [&](const char *label) {
+        Latency latency = Summarize(times_ms);
+        printf("%-10s %10.3f %10.3f %10.4f %10.4f\n", label, latency.mean_ms, latency.p99_ms,
+               static_cast<double>(top1) / num_queries, wanted ? static_cast<double>(found) / wanted : 1.0);
+        top1 = found = wanted = 0;
+    };
+
+    // search_batch() over consecutive queries; every query of a batch gets its share of the time
+    auto run_batch = [&](const char *name) {
+        std::vector<GalleryHit> hits(options.batch * k);
+        std::vector<size_t> counts(options.batch);
+        for (size_t first = 0; first < num_queries; first += options.batch)
+        {
+            const size_t batch = std::min(options.batch, num_queries - first);
+            auto start = std::chrono::steady_clock::now();
+            database.search_batch(queries.data() + first * dim, batch, dim, k, hits.data(), counts.data());
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            for (size_t q = 0; q < batch; q++)
+            {
+                times_ms[first + q] = ms / batch;
+                score(first + q, hits.data() + q * k, counts[q]);
+            }
+        }
+        char label[32];
+        snprintf(label, sizeof(label), "%s x%zu", name, options.batch);
+        report(label);
+    };
+    run_batch("exact");
+
+    // Watchlist tier: an exact scan of its own rows, so only its latency is comparable
+    if (options.watchlist > 0)
+    {
+        for (size_t id = 0; id < std::min(options.watchlist, database.size()); id++)
+            database.set_watchlist(static_cast<int>(id), true);
+        std::vector<GalleryHit> hits(k);
+        for (size_t q = 0; q < num_queries; q++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            database.search(queries.data() + q * dim, dim, k, hits.data(), GalleryTier::kWatchlist);
+            times_ms[q] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        Latency latency = Summarize(times_ms);
+        printf("%-10s %10.3f %10.3f   (%zu templates)\n", "watchlist", latency.mean_ms, latency.p99_ms,
+               database.num_watchlist_templates());
+    }
+
+    // search() against the reference, with whatever the database has enabled
+    auto run = [&](const char *label) {
+        std::vector<GalleryHit> hits(k);
+        for (size_t q = 0; q < num_queries; q++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            size_t count = database.search(queries.data() + q * dim, dim, k, hits.data());
+            times_ms[q] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            score(q, hits.data(), count);
+        }
+        report(label);
+    };
+
+    database.enable_quantization(options.rerank);
+    run("int8");
+    run_batch("int8");
+
+    auto build_start = std::chrono::steady_clock::now();
+    database.enable_index(options.m, options.ef_construction, options.ef_search.front(), 0);
+    double build_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - build_start).count();
+    printf("HNSW build: M=%zu efConstruction=%zu, %.1f s (%.0f templates/s)\n", options.m, options.ef_construction,
+           build_s, num_templates / build_s);
+    for (size_t ef : options.ef_search)
+    {
+        database.set_index_ef_search(ef);
+        char label[32];
+        snprintf(label, sizeof(label), "ef=%zu", ef);
+        run(label);
+    }
+    return 0;
+}
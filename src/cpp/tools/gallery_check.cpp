@@ -0,0 +1,237 @@
+/*
+ * gallery_check: round-trip checks of the gallery file and its write-ahead log.
+ *
+ *   1. Save a gallery with thresholds, a watchlist identity, the HNSW index and the int8
+ *      rows, open it again and compare identities, templates, flags and sections.
+ *   2. Log enrollments, cut the last log record short as a crash would, and check that
+ *      the next open() replays the complete records and appends after them.
+ *   3. Patch the saved file to version 2, whose identity entries have no watchlist flag,
+ *      and check that it is rejected (and accepted once the flag is cleared).
+ *
+ * Files are written to a temporary directory (-d to choose one). Exit status 0 when every
+ * check passes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "utils/face_database.h"
+
+constexpr size_t kDimension = 24;
+
+// Layout of the gallery file fields the version check patches (see face_database.cpp)
+constexpr size_t kHeaderVersionOffset = 4;
+constexpr size_t kHeaderSectionCountOffset = 20;
+constexpr size_t kHeaderSize = 64;
+constexpr size_t kSectionEntrySize = 24; // type, reserved, offset, size
+constexpr uint32_t kSectionIdentities = 3;
+constexpr size_t kIdentityEntrySize = 20; // id, name offset, name size, flags, threshold
+constexpr size_t kIdentityFlagsOffset = 12;
+constexpr uint32_t kIdentityWatchlist = 2;
+
+// Enrolled templates with their identity
+using Templates = std::vector<std::pair<int, std::vector<float>>>;
+
+static int g_failures = 0;
+
+static void Check(bool condition, const char *what)
+{
+    printf("%s %s\n", condition ? "ok  " : "FAIL", what);
+    if (!condition)
+        g_failures++;
+}
+
+static std::vector<float> RandomEmbedding(std::mt19937 &rng)
+{
+    std::normal_distribution<float> normal;
+    std::vector<float> embedding(kDimension);
+    for (float &value : embedding)
+        value = normal(rng);
+    return embedding;
+}
+
+static std::vector<uint8_t> ReadFile(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void WriteFile(const std::string &path, const std::vector<uint8_t> &bytes)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+}
+
+// Every template finds its own identity first, at similarity 1
+static bool FindsEveryTemplate(const FaceDatabase &database, const Templates &templates)
+{
+    for (const auto &entry : templates)
+    {
+        GalleryHit hit;
+        if (database.search(entry.second.data(), kDimension, 1, &hit) != 1 || hit.identity_id != entry.first ||
+            std::fabs(hit.similarity - 1.0f) > 1e-3f)
+            return false;
+    }
+    return true;
+}
+
+static void CheckRoundTrip(const std::string &dir, std::mt19937 &rng)
+{
+    const std::string path = dir + "/round_trip.fdb";
+    FaceDatabase database;
+    Templates templates;
+    for (int i = 0; i < 40; i++)
+    {
+        const int id = database.add_identity("person " + std::to_string(i));
+        for (int t = 0; t < 3; t++)
+        {
+            templates.emplace_back(id, RandomEmbedding(rng));
+            database.add_embedding_to_identity(id, templates.back().second);
+        }
+    }
+    database.set_identity_threshold(3, 0.75f);
+    database.set_watchlist(5, true);
+    database.enable_index(8, 64, 32, 0);
+    database.enable_quantization(16);
+    Check(database.save(path), "save a gallery with index and int8 rows");
+
+    FaceDatabase loaded;
+    Check(loaded.open(path), "open it again");
+    Check(loaded.size() == database.size() && loaded.num_templates() == database.num_templates() &&
+              loaded.embedding_size() == kDimension,
+          "identity, template and dimension counts survive");
+    bool names = true;
+    for (int i = 0; i < 40; i++)
+        names = names && loaded.get_identity_name(i) == "person " + std::to_string(i);
+    Check(names, "names survive");
+    Check(loaded.identity_threshold(3, 0.5f) == 0.75f && loaded.identity_threshold(4, 0.5f) == 0.5f,
+          "thresholds survive");
+    Check(loaded.is_watchlist(5) && !loaded.is_watchlist(6) && loaded.num_watchlist_templates() == 3,
+          "watchlist flag and its templates survive");
+    Check(loaded.index() != nullptr && loaded.index()->Size() == loaded.num_templates(), "HNSW index is loaded");
+    Check(loaded.quantized(), "int8 rows are loaded");
+    Check(FindsEveryTemplate(loaded, templates), "every template matches itself");
+    const int new_id = loaded.add_identity("late");
+    templates.emplace_back(new_id, RandomEmbedding(rng));
+    loaded.add_embedding_to_identity(new_id, templates.back().second);
+    Check(FindsEveryTemplate(loaded, templates), "enrolling after open() keeps the mapped templates");
+}
+
+static void CheckTornLog(const std::string &dir, std::mt19937 &rng)
+{
+    const std::string path = dir + "/torn_log.fdb";
+    Templates templates;
+    {
+        FaceDatabase database;
+        Check(database.open(path), "open a new gallery with a log");
+        const int id = database.add_identity("logged");
+        for (int t = 0; t < 3; t++)
+        {
+            templates.emplace_back(id, RandomEmbedding(rng));
+            database.add_embedding_to_identity(id, templates.back().second);
+        }
+    }
+
+    // A crash in the middle of the last record
+    std::vector<uint8_t> log = ReadFile(path + ".wal");
+    log.resize(log.size() - kDimension * sizeof(float) / 2);
+    WriteFile(path + ".wal", log);
+    templates.pop_back();
+
+    {
+        FaceDatabase database;
+        Check(database.open(path), "open with a torn last log record");
+        Check(database.size() == 1 && database.num_templates() == 2, "the complete records are replayed");
+        Check(FindsEveryTemplate(database, templates), "replayed templates match themselves");
+        templates.emplace_back(0, RandomEmbedding(rng));
+        database.add_embedding_to_identity(0, templates.back().second);
+    }
+    FaceDatabase database;
+    Check(database.open(path) && database.num_templates() == 3 && FindsEveryTemplate(database, templates),
+          "records appended after the torn one are replayed");
+}
+
+static void CheckVersionFlags(const std::string &dir)
+{
+    // The round-trip file has identity 5 on the watchlist
+    const std::string path = dir + "/round_trip.fdb";
+    const std::string patched_path = dir + "/version2.fdb";
+    std::vector<uint8_t> bytes = ReadFile(path);
+    Check(bytes.size() > kHeaderSize, "read the saved gallery");
+    if (bytes.size() <= kHeaderSize)
+        return;
+
+    uint32_t num_sections = 0;
+    std::memcpy(&num_sections, bytes.data() + kHeaderSectionCountOffset, sizeof(num_sections));
+    uint64_t identities_offset = 0, identities_size = 0;
+    for (uint32_t i = 0; i < num_sections; i++)
+    {
+        const uint8_t *section = bytes.data() + kHeaderSize + i * kSectionEntrySize;
+        uint32_t type;
+        std::memcpy(&type, section, sizeof(type));
+        if (type == kSectionIdentities)
+        {
+            std::memcpy(&identities_offset, section + 8, sizeof(identities_offset));
+            std::memcpy(&identities_size, section + 16, sizeof(identities_size));
+        }
+    }
+
+    const uint32_t version = 2;
+    std::memcpy(bytes.data() + kHeaderVersionOffset, &version, sizeof(version));
+    WriteFile(patched_path, bytes);
+    FaceDatabase database;
+    Check(!database.open(patched_path), "a version 2 file with the watchlist flag is rejected");
+
+    for (uint64_t entry = 0; entry + kIdentityEntrySize <= identities_size; entry += kIdentityEntrySize)
+    {
+        uint8_t *flags_bytes = bytes.data() + identities_offset + entry + kIdentityFlagsOffset;
+        uint32_t flags;
+        std::memcpy(&flags, flags_bytes, sizeof(flags));
+        flags &= ~kIdentityWatchlist;
+        std::memcpy(flags_bytes, &flags, sizeof(flags));
+    }
+    WriteFile(patched_path, bytes);
+    Check(database.open(patched_path) && !database.is_watchlist(5) && database.identity_threshold(3, 0.5f) == 0.75f,
+          "the same file without the flag loads as version 2");
+}
+
+int main(int argc, char *argv[])
+{
+    std::string dir;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:h")) != -1)
+    {
+        if (opt == 'd')
+        {
+            dir = optarg;
+            continue;
+        }
+        printf("-d: directory for the gallery files,\tdefault: a new temporary one\n");
+        return 1;
+    }
+    if (dir.empty())
+    {
+        char temp_dir[] = "/tmp/gallery_check.XXXXXX";
+        if (!mkdtemp(temp_dir))
+        {
+            perror("mkdtemp");
+            return 1;
+        }
+        dir = temp_dir;
+    }
+
+    std::mt19937 rng(7);
+    CheckRoundTrip(dir, rng);
+    CheckTornLog(dir, rng);
+    CheckVersionFlags(dir);
+
+    printf("%s: %d failed (files in %s)\n", g_failures ? "FAILED" : "passed", g_failures, dir.c_str());
+    return g_failures ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * gallery_compact: fold a gallery file's write-ahead log back into the file.
+ *
+ *   1. Open the gallery file (-g) and replay the enrollments logged in <file>.wal since it
+ *      was written.
+ *   2. Optionally build the HNSW index (-x) and the int8 rows (-q), so that processes
+ *      opening the file map them instead of building them at startup.
+ *   3. Write a new gallery file (-o, default: over the input) and, when it replaces the
+ *      input, empty the log. Processes that have the old file mapped keep reading it until
+ *      they reopen.
+ *
+ * Run it offline: enrollments logged by other processes while it runs would be lost.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+
+#include "utils/face_database.h"
+
+struct CompactOptions
+{
+    std::string gallery_path;
+    std::string output_path; // empty = in place
+    bool index = false;
+    size_t m = 16;
+    size_t ef_construction = 200;
+    bool quantize = false;
+};
+
+static void ParseArgs(int argc, char *argv[], CompactOptions &options)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "g:o:xm:c:qh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'g':
+            options.gallery_path = optarg;
+            break;
+        case 'o':
+            options.output_path = optarg;
+            break;
+        case 'x':
+            options.index = true;
+            break;
+        case 'm':
+            options.m = std::stoul(optarg);
+            break;
+        case 'c':
+            options.ef_construction = std::stoul(optarg);
+            break;
+        case 'q':
+            options.quantize = true;
+            break;
+        case 'h':
+        default:
+            printf("-g: gallery file (its log is <file>.wal)\n");
+            printf("-o: output gallery file,\t\tdefault: in place\n");
+            printf("-x: store an HNSW index\n");
+            printf("-m: HNSW links per node (M),\t\tdefault: 16\n");
+            printf("-c: HNSW efConstruction,\t\tdefault: 200\n");
+            printf("-q: store int8 rows for the int8 scan\n");
+            exit(1);
+        }
+    }
+    if (options.gallery_path.empty())
+    {
+        fprintf(stderr, "a gallery file is required (-g)\n");
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    CompactOptions options;
+    ParseArgs(argc, argv, options);
+
+    FaceDatabase database;
+    auto start = std::chrono::steady_clock::now();
+    if (!database.open(options.gallery_path))
+        return 1;
+    printf("%s: %zu identities, %zu templates of %zu floats\n", options.gallery_path.c_str(), database.size(),
+           database.num_templates(), database.embedding_size());
+
+    if (options.index)
+        database.enable_index(options.m, options.ef_construction);
+    if (options.quantize)
+        database.enable_quantization();
+
+    const std::string &output = options.output_path.empty() ? options.gallery_path : options.output_path;
+    if (!database.save(output))
+        return 1;
+    printf("wrote %s%s%s in %.1f s\n", output.c_str(), database.index() ? ", with HNSW index" : "",
+           database.quantized() ? ", with int8 rows" : "",
+           std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return 0;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+/**
+ * @brief Heap buffer aligned for SIMD loads and ORT tensors.
+ *
+ * Unlike std::vector it never shrinks or copies on Resize() when the capacity is
+ * already large enough, so a buffer sized once at startup is reused for every frame.
+ */
+template <typename T, size_t Alignment = 64>
+class AlignedBuffer
+{
+public:
+    AlignedBuffer() : data_(nullptr), size_(0), capacity_(0) {}
+    explicit AlignedBuffer(size_t count) : AlignedBuffer() { Resize(count); }
+    ~AlignedBuffer() { std::free(data_); }
+
+    AlignedBuffer(const AlignedBuffer &) = delete;
+    AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+
+    AlignedBuffer(AlignedBuffer &&other) noexcept
+        : data_(other.data_), size_(other.size_), capacity_(other.capacity_)
+    {
+        other.data_ = nullptr;
+        other.size_ = other.capacity_ = 0;
+    }
+
+    AlignedBuffer &operator=(AlignedBuffer &&other) noexcept
+    {
+        std::swap(data_, other.data_);
+        std::swap(size_, other.size_);
+        std::swap(capacity_, other.capacity_);
+        return *this;
+    }
+
+    /** @brief Set the element count, reallocating (zero-filled) only when it exceeds the capacity. */
+    void Resize(size_t count)
+    {
+        if (count > capacity_) {
+            size_t bytes = (count * sizeof(T) + Alignment - 1) / Alignment * Alignment;
+            T *data = static_cast<T *>(std::aligned_alloc(Alignment, bytes));
+            if (!data) {
+                throw std::bad_alloc();
+            }
+            std::memset(static_cast<void *>(data), 0, bytes);
+            std::free(data_);
+            data_ = data;
+            capacity_ = bytes / sizeof(T);
+        }
+        size_ = count;
+    }
+
+    T *data() { return data_; }
+    const T *data() const { return data_; }
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+
+    T &operator[](size_t i) { return data_[i]; }
+    const T &operator[](size_t i) const { return data_[i]; }
+
+    T *begin() { return data_; }
+    T *end() { return data_ + size_; }
+    const T *begin() const { return data_; }
+    const T *end() const { return data_ + size_; }
+
+private:
+    T *data_;
+    size_t size_;
+    size_t capacity_;
+};
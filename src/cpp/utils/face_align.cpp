@@ -0,0 +1,235 @@
+#include "face_align.h"
+#include <cmath>
+#include <algorithm>
+#include <immintrin.h>
+
+namespace {
+
+// ArcFace/InsightFace landmark template for a 112x112 crop:
+// left eye, right eye, nose tip, left and right mouth corner
+constexpr float kTemplateSize = 112.0f;
+constexpr float kTemplateX[5] = {38.2946f, 73.5318f, 56.0252f, 41.5493f, 70.7299f};
+constexpr float kTemplateY[5] = {51.6963f, 51.5014f, 71.7366f, 92.3655f, 92.2041f};
+
+inline int Tap(const uint8_t *src, int src_width, int src_height, size_t src_stride, int x, int y, int c)
+{
+    if (x < 0 || y < 0 || x >= src_width || y >= src_height) {
+        return 0;
+    }
+    return src[y * src_stride + x * 3 + c];
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+template <int kShift>
+inline __m256 Channel256(__m256i pixels)
+{
+    return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, kShift), _mm256_set1_epi32(0xFF)));
+}
+
+template <int kShift>
+inline __m256 Blend256(__m256i p00, __m256i p01, __m256i p10, __m256i p11,
+                       __m256 wx0, __m256 wx1, __m256 wy0, __m256 wy1)
+{
+    __m256 top = _mm256_fmadd_ps(Channel256<kShift>(p01), wx1, _mm256_mul_ps(Channel256<kShift>(p00), wx0));
+    __m256 bottom = _mm256_fmadd_ps(Channel256<kShift>(p11), wx1, _mm256_mul_ps(Channel256<kShift>(p10), wx0));
+    return _mm256_fmadd_ps(bottom, wy1, _mm256_mul_ps(top, wy0));
+}
+
+// Lanes whose coordinate lies inside [0, size)
+inline __m256i InRange(__m256i value, __m256i size)
+{
+    return _mm256_and_si256(_mm256_cmpgt_epi32(value, _mm256_set1_epi32(-1)), _mm256_cmpgt_epi32(size, value));
+}
+#endif
+
+} // namespace
+
+FaceAligner::FaceAligner(int output_width, int output_height, bool channels_last,
+                         float pixel_mean, float pixel_scale)
+    : output_width_(output_width), output_height_(output_height), channels_last_(channels_last),
+      pixel_mean_(pixel_mean), pixel_scale_(pixel_scale)
+{
+    for (int i = 0; i < 5; i++) {
+        template_x_[i] = kTemplateX[i] * output_width_ / kTemplateSize;
+        template_y_[i] = kTemplateY[i] * output_height_ / kTemplateSize;
+    }
+}
+
+void FaceAligner::Run(const cv::Mat &rgb_image, const FaceKeypoint *keypoints, size_t count, float *dst)
+{
+    SolveTransforms(keypoints, count);
+
+    const size_t plane_size = static_cast<size_t>(output_width_) * output_height_;
+    if (channels_last_) {
+        planar_.Resize(plane_size * 3);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        float *crop = dst + i * OutputElements();
+        float *planes = channels_last_ ? planar_.data() : crop;
+        WarpFace(rgb_image.data, rgb_image.cols, rgb_image.rows, rgb_image.step, transforms_.data() + i * 6,
+                 planes, planes + plane_size, planes + 2 * plane_size);
+
+        if (channels_last_) {
+            for (size_t p = 0; p < plane_size; p++) {
+                crop[p * 3] = planes[p];
+                crop[p * 3 + 1] = planes[plane_size + p];
+                crop[p * 3 + 2] = planes[2 * plane_size + p];
+            }
+        }
+    }
+}
+
+void FaceAligner::SolveTransforms(const FaceKeypoint *face_keypoints, size_t count)
+{
+    transforms_.Resize(count * 6);
+
+    float dst_mean_x = 0.0f, dst_mean_y = 0.0f;
+    for (int k = 0; k < 5; k++) {
+        dst_mean_x += template_x_[k] * 0.2f;
+        dst_mean_y += template_y_[k] * 0.2f;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const FaceKeypoint *keypoints = face_keypoints + i * kNumFaceKeypoints;
+
+        // Least-squares similarity from the landmarks to the template (Umeyama, no reflection)
+        float src_mean_x = 0.0f, src_mean_y = 0.0f;
+        for (int k = 0; k < 5; k++) {
+            src_mean_x += keypoints[k].x * 0.2f;
+            src_mean_y += keypoints[k].y * 0.2f;
+        }
+
+        float variance = 0.0f, dot = 0.0f, cross = 0.0f;
+        for (int k = 0; k < 5; k++) {
+            float sx = keypoints[k].x - src_mean_x;
+            float sy = keypoints[k].y - src_mean_y;
+            float tx = template_x_[k] - dst_mean_x;
+            float ty = template_y_[k] - dst_mean_y;
+            variance += sx * sx + sy * sy;
+            dot += sx * tx + sy * ty;
+            cross += sx * ty - sy * tx;
+        }
+
+        float a = 1.0f, b = 0.0f;
+        if (variance > 0.0f && (dot != 0.0f || cross != 0.0f)) {
+            a = dot / variance;
+            b = cross / variance;
+        }
+        const float shift_x = dst_mean_x - (a * src_mean_x - b * src_mean_y);
+        const float shift_y = dst_mean_y - (b * src_mean_x + a * src_mean_y);
+
+        // The warp walks output pixels, so store the inverse mapping
+        const float inv_det = 1.0f / (a * a + b * b);
+        float *t = transforms_.data() + i * 6;
+        t[0] = a * inv_det;
+        t[1] = b * inv_det;
+        t[2] = -(a * shift_x + b * shift_y) * inv_det;
+        t[3] = -b * inv_det;
+        t[4] = a * inv_det;
+        t[5] = (b * shift_x - a * shift_y) * inv_det;
+    }
+}
+
+void FaceAligner::WarpFace(const uint8_t *src, int src_width, int src_height, size_t src_stride,
+                           const float *transform, float *dst_r, float *dst_g, float *dst_b) const
+{
+    const float offset = -pixel_mean_ * pixel_scale_;
+    // A 32-bit gather at a pixel past this byte offset would read beyond the frame
+    const int64_t last_gather_offset = static_cast<int64_t>(src_height - 1) * src_stride + (src_width - 1) * 3 - 1;
+
+    for (int y = 0; y < output_height_; y++) {
+        const float row_x = transform[1] * y + transform[2];
+        const float row_y = transform[4] * y + transform[5];
+        const size_t row_offset = static_cast<size_t>(y) * output_width_;
+        int x = 0;
+
+#if defined(__AVX2__) && defined(__FMA__)
+        {
+            const __m256 lane = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+            const __m256 one = _mm256_set1_ps(1.0f);
+            const __m256 scale = _mm256_set1_ps(pixel_scale_);
+            const __m256 bias = _mm256_set1_ps(offset);
+            const __m256i width = _mm256_set1_epi32(src_width);
+            const __m256i height = _mm256_set1_epi32(src_height);
+            const __m256i stride = _mm256_set1_epi32(static_cast<int>(src_stride));
+            const __m256i last_offset = _mm256_set1_epi32(static_cast<int>(last_gather_offset));
+            const int *base = reinterpret_cast<const int *>(src);
+
+            for (; x + 8 <= output_width_; x += 8) {
+                __m256 vx = _mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lane);
+                __m256 sx = _mm256_fmadd_ps(_mm256_set1_ps(transform[0]), vx, _mm256_set1_ps(row_x));
+                __m256 sy = _mm256_fmadd_ps(_mm256_set1_ps(transform[3]), vx, _mm256_set1_ps(row_y));
+                __m256 fx = _mm256_floor_ps(sx);
+                __m256 fy = _mm256_floor_ps(sy);
+                __m256 wx1 = _mm256_sub_ps(sx, fx);
+                __m256 wy1 = _mm256_sub_ps(sy, fy);
+                __m256 wx0 = _mm256_sub_ps(one, wx1);
+                __m256 wy0 = _mm256_sub_ps(one, wy1);
+
+                __m256i x0 = _mm256_cvttps_epi32(fx);
+                __m256i y0 = _mm256_cvttps_epi32(fy);
+                __m256i x1 = _mm256_add_epi32(x0, _mm256_set1_epi32(1));
+                __m256i y1 = _mm256_add_epi32(y0, _mm256_set1_epi32(1));
+
+                __m256i vx0 = InRange(x0, width), vx1 = InRange(x1, width);
+                __m256i vy0 = InRange(y0, height), vy1 = InRange(y1, height);
+                __m256i m00 = _mm256_and_si256(vx0, vy0), m01 = _mm256_and_si256(vx1, vy0);
+                __m256i m10 = _mm256_and_si256(vx0, vy1), m11 = _mm256_and_si256(vx1, vy1);
+
+                __m256i col0 = _mm256_add_epi32(x0, _mm256_add_epi32(x0, x0));
+                __m256i col1 = _mm256_add_epi32(col0, _mm256_set1_epi32(3));
+                __m256i line0 = _mm256_mullo_epi32(y0, stride);
+                __m256i line1 = _mm256_add_epi32(line0, stride);
+                __m256i o00 = _mm256_add_epi32(line0, col0), o01 = _mm256_add_epi32(line0, col1);
+                __m256i o10 = _mm256_add_epi32(line1, col0), o11 = _mm256_add_epi32(line1, col1);
+
+                // Only the frame's very last pixel is unsafe to gather; leave those blocks to the scalar path
+                __m256i tail = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_and_si256(m00, _mm256_cmpgt_epi32(o00, last_offset)),
+                                    _mm256_and_si256(m01, _mm256_cmpgt_epi32(o01, last_offset))),
+                    _mm256_or_si256(_mm256_and_si256(m10, _mm256_cmpgt_epi32(o10, last_offset)),
+                                    _mm256_and_si256(m11, _mm256_cmpgt_epi32(o11, last_offset))));
+                if (!_mm256_testz_si256(tail, tail)) {
+                    break;
+                }
+
+                const __m256i zero = _mm256_setzero_si256();
+                __m256i p00 = _mm256_mask_i32gather_epi32(zero, base, o00, m00, 1);
+                __m256i p01 = _mm256_mask_i32gather_epi32(zero, base, o01, m01, 1);
+                __m256i p10 = _mm256_mask_i32gather_epi32(zero, base, o10, m10, 1);
+                __m256i p11 = _mm256_mask_i32gather_epi32(zero, base, o11, m11, 1);
+
+                _mm256_storeu_ps(dst_r + row_offset + x,
+                                 _mm256_fmadd_ps(Blend256<0>(p00, p01, p10, p11, wx0, wx1, wy0, wy1), scale, bias));
+                _mm256_storeu_ps(dst_g + row_offset + x,
+                                 _mm256_fmadd_ps(Blend256<8>(p00, p01, p10, p11, wx0, wx1, wy0, wy1), scale, bias));
+                _mm256_storeu_ps(dst_b + row_offset + x,
+                                 _mm256_fmadd_ps(Blend256<16>(p00, p01, p10, p11, wx0, wx1, wy0, wy1), scale, bias));
+            }
+        }
+#endif
+
+        // Scalar tail, and the whole row on targets without AVX2
+        for (; x < output_width_; x++) {
+            // Anything beyond one pixel outside the frame samples black, so clamp before converting
+            const float sx = std::min(std::max(transform[0] * x + row_x, -2.0f), src_width + 1.0f);
+            const float sy = std::min(std::max(transform[3] * x + row_y, -2.0f), src_height + 1.0f);
+            const float fx = std::floor(sx);
+            const float fy = std::floor(sy);
+            const float wx1 = sx - fx, wx0 = 1.0f - wx1;
+            const float wy1 = sy - fy, wy0 = 1.0f - wy1;
+            const int x0 = static_cast<int>(fx);
+            const int y0 = static_cast<int>(fy);
+
+            float *planes[3] = {dst_r, dst_g, dst_b};
+            for (int c = 0; c < 3; c++) {
+                float top = Tap(src, src_width, src_height, src_stride, x0, y0, c) * wx0 +
+                            Tap(src, src_width, src_height, src_stride, x0 + 1, y0, c) * wx1;
+                float bottom = Tap(src, src_width, src_height, src_stride, x0, y0 + 1, c) * wx0 +
+                               Tap(src, src_width, src_height, src_stride, x0 + 1, y0 + 1, c) * wx1;
+                planes[c][row_offset + x] = (top * wy0 + bottom * wy1) * pixel_scale_ + offset;
+            }
+        }
+    }
+}
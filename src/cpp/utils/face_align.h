@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <opencv2/opencv.hpp>
+#include "face_core.h"
+#include "aligned_buffer.h"
+
+/**
+ * @brief Batched 5-point face alignment that warps straight into an embedding model's input.
+ *
+ * The similarity transforms of all faces of a frame are solved together, then each face
+ * is sampled from the full frame with a SIMD bilinear warp that normalizes and writes the
+ * planar float crop into its slot of the batched tensor. No intermediate crops are made,
+ * so the cost is proportional to the number of output pixels. Samples outside the frame
+ * are black, as with cv::warpAffine(BORDER_CONSTANT).
+ */
+class FaceAligner
+{
+public:
+    /**
+     * @param output_width, output_height  Size of one aligned crop.
+     * @param channels_last                Write HWC crops instead of planar CHW.
+     * @param pixel_mean, pixel_scale      Output is (pixel - pixel_mean) * pixel_scale.
+     */
+    FaceAligner(int output_width, int output_height, bool channels_last,
+                float pixel_mean = 127.5f, float pixel_scale = 1.0f / 128.0f);
+
+    /**
+     * @brief Align count faces of one frame.
+     * @param rgb_image  Interleaved RGB frame the keypoints refer to.
+     * @param keypoints  kNumFaceKeypoints landmarks per face, faces back to back.
+     * @param dst        Receives count crops back to back, OutputElements() floats each, R, G, B order.
+     */
+    void Run(const cv::Mat &rgb_image, const FaceKeypoint *keypoints, size_t count, float *dst);
+
+    size_t OutputElements() const { return static_cast<size_t>(output_width_) * output_height_ * 3; }
+
+private:
+    /** @brief Fill transforms_ with the output-to-frame mapping of every face. */
+    void SolveTransforms(const FaceKeypoint *keypoints, size_t count);
+
+    /** @brief Bilinear warp of one face into planar R, G, B outputs. */
+    void WarpFace(const uint8_t *src, int src_width, int src_height, size_t src_stride,
+                  const float *transform, float *dst_r, float *dst_g, float *dst_b) const;
+
+    int output_width_;
+    int output_height_;
+    bool channels_last_;
+    float pixel_mean_;
+    float pixel_scale_;
+
+    // Landmark template scaled to the crop, in the detector's keypoint order
+    float template_x_[5];
+    float template_y_[5];
+
+    // 6 coefficients per face: source x = t0*x + t1*y + t2, source y = t3*x + t4*y + t5
+    AlignedBuffer<float> transforms_;
+    // Planar staging for channels-last models
+    AlignedBuffer<float> planar_;
+};
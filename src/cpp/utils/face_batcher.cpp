@@ -0,0 +1,218 @@
+#include "face_batcher.h"
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+FaceBatcher::FaceBatcher(SessionPool &detector_pool, size_t max_batch_size, float max_latency_ms)
+    : detector_pool_(detector_pool),
+      max_batch_size_(max_batch_size > 0 ? max_batch_size : 1),
+      max_latency_(static_cast<int64_t>(max_latency_ms * 1000.0f)),
+      memory_info_(Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault)),
+      num_clients_(0),
+      running_(true)
+{
+    const auto& input_shape = detector_pool_.InputShapes()[0];
+    const auto& output_shape = detector_pool_.OutputShapes()[0];
+    if (input_shape.size() != 4) {
+        throw std::invalid_argument("FaceBatcher expects an NCHW detector input.");
+    }
+
+    input_elements_ = 1;
+    for (size_t i = 1; i < input_shape.size(); i++) {
+        if (input_shape[i] <= 0) {
+            throw std::invalid_argument("FaceBatcher requires fixed channel and spatial input dimensions.");
+        }
+        input_elements_ *= input_shape[i];
+    }
+
+    output_elements_ = 1;
+    for (size_t i = 1; i < output_shape.size(); i++) {
+        if (output_shape[i] <= 0) {
+            throw std::invalid_argument("FaceBatcher requires a fixed per-image output shape.");
+        }
+        output_elements_ *= output_shape[i];
+    }
+
+    // A model exported with a static batch of 1 cannot be batched
+    if (input_shape[0] > 0 && static_cast<size_t>(input_shape[0]) < max_batch_size_) {
+        printf("(FaceBatcher) model %s has a fixed batch of %ld, batching limited to that size\n",
+               detector_pool_.ModelPath().c_str(), static_cast<long>(input_shape[0]));
+        max_batch_size_ = input_shape[0];
+    }
+
+    queue_.reserve(64);
+
+    for (size_t i = 0; i < detector_pool_.NumSessions(); i++) {
+        workers_.emplace_back(&FaceBatcher::WorkerLoop, this);
+    }
+}
+
+FaceBatcher::~FaceBatcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    queue_cv_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    // Requests no worker took before stopping fail rather than block their channel forever
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto request : queue_) {
+            request->ok = false;
+            request->done = true;
+        }
+        queue_.clear();
+    }
+    done_cv_.notify_all();
+}
+
+void FaceBatcher::RegisterClient()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_clients_++;
+    if (queue_.capacity() < num_clients_) {
+        queue_.reserve(num_clients_);
+    }
+}
+
+bool FaceBatcher::Infer(const float *input, float *output)
+{
+    Request request;
+    request.input = input;
+    request.output = output;
+    request.enqueue_time = std::chrono::steady_clock::now();
+    request.done = false;
+    request.ok = false;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!running_) {
+        return false;
+    }
+    queue_.push_back(&request);
+    queue_cv_.notify_one();
+    done_cv_.wait(lock, [&request]() { return request.done; });
+    return request.ok;
+}
+
+void FaceBatcher::WorkerLoop()
+{
+    std::vector<int64_t> input_shape = detector_pool_.InputShapes()[0];
+    std::vector<int64_t> output_shape = detector_pool_.OutputShapes()[0];
+
+    BatchSlot slot;
+    slot.input.Resize(max_batch_size_ * input_elements_);
+    slot.output.Resize(max_batch_size_ * output_elements_);
+    for (size_t batch_size = 1; batch_size <= max_batch_size_; batch_size++) {
+        input_shape[0] = output_shape[0] = static_cast<int64_t>(batch_size);
+        slot.input_values.push_back(Ort::Value::CreateTensor<float>(
+            memory_info_, slot.input.data(), batch_size * input_elements_, input_shape.data(), input_shape.size()));
+        slot.output_values.push_back(Ort::Value::CreateTensor<float>(
+            memory_info_, slot.output.data(), batch_size * output_elements_, output_shape.data(), output_shape.size()));
+    }
+    slot.bindings.reserve(detector_pool_.NumSessions());
+
+    std::vector<Request *> batch;
+    batch.reserve(max_batch_size_);
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            queue_cv_.wait(lock, [this]() { return !running_ || !queue_.empty(); });
+            if (!running_) {
+                return;
+            }
+
+            // Each channel has at most one input in flight, so never wait for more than that
+            size_t target = std::min(max_batch_size_, std::max<size_t>(num_clients_, 1));
+            auto deadline = queue_.front()->enqueue_time + max_latency_;
+            queue_cv_.wait_until(lock, deadline, [this, target]() {
+                return !running_ || queue_.empty() || queue_.size() >= target;
+            });
+            if (!running_) {
+                return;
+            }
+            if (queue_.empty()) {
+                // Another worker took the inputs while this one was waiting
+                continue;
+            }
+
+            size_t count = std::min(queue_.size(), max_batch_size_);
+            batch.assign(queue_.begin(), queue_.begin() + count);
+            queue_.erase(queue_.begin(), queue_.begin() + count);
+        }
+
+        // The session is held for this batch only; the pool is shared with direct callers
+        bool ok;
+        {
+            auto session = detector_pool_.Borrow();
+            ok = RunBatch(*session, slot, batch);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto request : batch) {
+                request->ok = ok;
+                request->done = true;
+            }
+        }
+        done_cv_.notify_all();
+    }
+}
+
+bool FaceBatcher::RunBatch(Ort::Session &session, BatchSlot &slot, std::vector<Request *> &batch)
+{
+    const size_t batch_size = batch.size();
+
+    // Gather the letterboxed inputs into the bound NCHW tensor
+    for (size_t i = 0; i < batch_size; i++) {
+        std::memcpy(slot.input.data() + i * input_elements_, batch[i]->input, input_elements_ * sizeof(float));
+    }
+
+    try {
+        session.Run(Ort::RunOptions{nullptr}, GetBindings(session, slot)[batch_size - 1]);
+    }
+    catch (const Ort::Exception& e) {
+        std::cerr << "ONNX Runtime batched inference error: " << e.what() << std::endl;
+        return false;
+    }
+
+    // Scatter each image's slice of the output back to its channel
+    for (size_t i = 0; i < batch_size; i++) {
+        std::memcpy(batch[i]->output, slot.output.data() + i * output_elements_, output_elements_ * sizeof(float));
+    }
+    return true;
+}
+
+std::vector<Ort::IoBinding> &FaceBatcher::GetBindings(Ort::Session &session, BatchSlot &slot)
+{
+    for (auto& entry : slot.bindings) {
+        if (entry.first == &session) {
+            return entry.second;
+        }
+    }
+
+    // At most one set per pooled session, so this only runs during warm-up
+    const char *input_name = detector_pool_.InputNames()[0];
+    const auto& output_names = detector_pool_.OutputNames();
+    std::vector<Ort::IoBinding> bindings;
+    for (size_t i = 0; i < max_batch_size_; i++) {
+        Ort::IoBinding binding(session);
+        binding.BindInput(input_name, slot.input_values[i]);
+        binding.BindOutput(output_names[0], slot.output_values[i]);
+        for (size_t j = 1; j < output_names.size(); j++) {
+            // Outputs the detector post-process does not read are left to ORT
+            binding.BindOutput(output_names[j], memory_info_);
+        }
+        bindings.push_back(std::move(binding));
+    }
+    slot.bindings.emplace_back(&session, std::move(bindings));
+    return slot.bindings.back().second;
+}
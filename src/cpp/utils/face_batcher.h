@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include "inference_service.h"
+#include "aligned_buffer.h"
+
+/**
+ * @brief Collects pre-processed detector inputs from several channels and runs them
+ * as one batched Ort::Session::Run.
+ *
+ * A batch is dispatched as soon as it is full, or when its oldest input has waited
+ * longer than the configured latency cap. One worker runs per pooled session so
+ * batches can overlap when the pool has more than one session. Workers borrow a session
+ * per batch, so channels running the pool directly are never starved by idle workers,
+ * and run it through IoBindings on preallocated batch buffers, kept per session, so
+ * dispatching a batch does not allocate once every session has been seen.
+ */
+class FaceBatcher
+{
+public:
+    /**
+     * @param detector_pool     Sessions of a detector exported with a dynamic batch dimension.
+     * @param max_batch_size    Maximum number of inputs per Run.
+     * @param max_latency_ms    Longest time an input waits for its batch to fill.
+     */
+    FaceBatcher(SessionPool &detector_pool, size_t max_batch_size, float max_latency_ms);
+
+    ~FaceBatcher();
+
+    /** @brief Register a channel that will submit inputs; a batch never waits for more inputs than there are clients. */
+    void RegisterClient();
+
+    /**
+     * @brief Submit one CHW input tensor and block until its detections are ready.
+     * @param input   Pre-processed input of one image, sized as the model's per-image input.
+     * @param output  Receives the model output for this image only, OutputElements() floats.
+     * @return false if the batch failed to run.
+     */
+    bool Infer(const float *input, float *output);
+
+    size_t MaxBatchSize() const { return max_batch_size_; }
+    size_t OutputElements() const { return output_elements_; }
+
+private:
+    struct Request
+    {
+        const float *input;
+        float *output;
+        std::chrono::steady_clock::time_point enqueue_time;
+        bool done;
+        bool ok;
+    };
+
+    /**
+     * @brief Worker-owned batch buffers, with one IoBinding per batch size for every session
+     * the worker has run, created on first use.
+     */
+    struct BatchSlot
+    {
+        AlignedBuffer<float> input;
+        AlignedBuffer<float> output;
+        std::vector<Ort::Value> input_values;
+        std::vector<Ort::Value> output_values;
+        std::vector<std::pair<Ort::Session *, std::vector<Ort::IoBinding>>> bindings;
+    };
+
+    void WorkerLoop();
+    bool RunBatch(Ort::Session &session, BatchSlot &slot, std::vector<Request *> &batch);
+    std::vector<Ort::IoBinding> &GetBindings(Ort::Session &session, BatchSlot &slot);
+
+    SessionPool &detector_pool_;
+    size_t max_batch_size_;
+    std::chrono::microseconds max_latency_;
+    size_t input_elements_;  // per-image input size
+    size_t output_elements_; // per-image output size
+    Ort::MemoryInfo memory_info_;
+
+    std::mutex mutex_;
+    std::condition_variable queue_cv_;
+    std::condition_variable done_cv_;
+    std::vector<Request *> queue_; // FIFO, oldest first
+    size_t num_clients_;
+    bool running_;
+
+    std::vector<std::thread> workers_;
+};
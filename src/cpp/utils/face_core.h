@@ -2,9 +2,12 @@
 
 #include <queue>
 #include <cstdlib>
+#include <algorithm>
 #include <vector>
+#include <string>
 #include <opencv2/opencv.hpp>
 #include <opencv2/imgproc.hpp>
+#include "aligned_buffer.h"
 
 #define mxutil_prepost_sigmoid(_x_) (1.0 / (1.0 + expf(-1.0 * (_x_))))
 #define mxutil_max(_x_, _y_) (((_x_) > (_y_)) ? (_x_) : (_y_))
@@ -38,7 +41,10 @@ struct FaceKeypoint
     FaceKeypoint(float _x, float _y, float _conf) : x(_x), y(_y), confidence(_conf) {}
 };
 
-// Face detection bounding box with keypoints
+// Eyes, nose tip and mouth corners
+constexpr size_t kNumFaceKeypoints = 5;
+
+// One decoded face; plain data so decoder scratch vectors never touch the heap per face
 struct FaceBox
 {
     float confidence;      // Face detection confidence
@@ -46,130 +52,89 @@ struct FaceBox
     float y_min;          // Top-left y coordinate
     float x_max;          // Bottom-right x coordinate
     float y_max;          // Bottom-right y coordinate
-    std::vector<FaceKeypoint> keypoints;  // 5 facial keypoints (eyes, nose, mouth corners)
-    std::vector<float> embedding;         // 128-dimensional face embedding
+    FaceKeypoint keypoints[kNumFaceKeypoints];  // 5 facial keypoints (eyes, nose, mouth corners)
     int identity_id;      // Assigned identity ID (-1 for unknown)
-    std::string identity_name;  // Identity name
+    int track_id;         // Tracker ID, stable across frames (-1 when untracked)
 
     // Default constructor
-    FaceBox() : confidence(-1), x_min(-1), y_min(-1), x_max(-1), y_max(-1),
-                identity_id(-1), identity_name("Unknown") {
-        keypoints.resize(5);
-        embedding.resize(128, 0.0f);
-    }
+    FaceBox() : confidence(-1), x_min(-1), y_min(-1), x_max(-1), y_max(-1), identity_id(-1), track_id(-1) {}
 
     // Parameterized constructor
     FaceBox(float _conf, float _x_min, float _y_min, float _x_max, float _y_max)
         : confidence(_conf), x_min(_x_min), y_min(_y_min), x_max(_x_max), y_max(_y_max),
-          identity_id(-1), identity_name("Unknown") {
-        keypoints.resize(5);
-        embedding.resize(128, 0.0f);
-    }
+          identity_id(-1), track_id(-1) {}
 };
 
-// Face recognition result structure
+// Face recognition result, one column per attribute so a result kept across frames
+// is refilled without allocating once it has seen the largest crowd
 struct FaceRecognitionResult
 {
-    std::vector<FaceBox> faces;
+    std::vector<float> confidence;
+    std::vector<float> x_min;
+    std::vector<float> y_min;
+    std::vector<float> x_max;
+    std::vector<float> y_max;
+    std::vector<FaceKeypoint> keypoints;  // kNumFaceKeypoints per face
+    std::vector<int> identity_id;         // -1 for unknown; names are interned by FaceDatabase
+    std::vector<int> track_id;            // -1 when untracked
+
+    // Embedding arena, embedding_size floats per face; only the rows of faces recognition ran on are filled
+    AlignedBuffer<float> embeddings;
+    size_t embedding_size;
+
     int num_faces;
+    bool detected;  // false when the boxes were propagated by the tracker instead of detected
 
-    FaceRecognitionResult() : num_faces(0) {}
+    FaceRecognitionResult() : embedding_size(0), num_faces(0), detected(true) {}
 
     void clear() {
-        faces.clear();
+        confidence.clear();
+        x_min.clear();
+        y_min.clear();
+        x_max.clear();
+        y_max.clear();
+        keypoints.clear();
+        identity_id.clear();
+        track_id.clear();
+        embedding_size = 0;
         num_faces = 0;
+        detected = true;
     }
 
     void add_face(const FaceBox& face) {
-        faces.push_back(face);
-        num_faces = faces.size();
+        confidence.push_back(face.confidence);
+        x_min.push_back(face.x_min);
+        y_min.push_back(face.y_min);
+        x_max.push_back(face.x_max);
+        y_max.push_back(face.y_max);
+        keypoints.insert(keypoints.end(), face.keypoints, face.keypoints + kNumFaceKeypoints);
+        identity_id.push_back(face.identity_id);
+        track_id.push_back(face.track_id);
+        num_faces++;
     }
-};
 
-// Face database entry for storing known identities
-struct FaceIdentity
-{
-    int id;
-    std::string name;
-    std::vector<std::vector<float>> embeddings;  // Multiple embeddings per identity
+    // Gather face i back into a FaceBox
+    FaceBox face(size_t i) const {
+        FaceBox box(confidence[i], x_min[i], y_min[i], x_max[i], y_max[i]);
+        std::copy(face_keypoints(i), face_keypoints(i) + kNumFaceKeypoints, box.keypoints);
+        box.identity_id = identity_id[i];
+        box.track_id = track_id[i];
+        return box;
+    }
 
-    FaceIdentity() : id(-1), name("Unknown") {}
-    FaceIdentity(int _id, const std::string& _name) : id(_id), name(_name) {}
+    const FaceKeypoint *face_keypoints(size_t i) const { return keypoints.data() + i * kNumFaceKeypoints; }
 
-    void add_embedding(const std::vector<float>& embedding) {
-        embeddings.push_back(embedding);
-    }
+    bool has_embeddings() const { return embedding_size > 0; }
+    float *embedding(size_t i) { return embeddings.data() + i * embedding_size; }
+    const float *embedding(size_t i) const { return embeddings.data() + i * embedding_size; }
 };
 
-// Simple face database for identity management
-class FaceDatabase
+// Best gallery match of one embedding
+struct FaceMatch
 {
-private:
-    std::vector<FaceIdentity> identities_;
-    int next_id_;
-
-public:
-    FaceDatabase() : next_id_(0) {}
-
-    int add_identity(const std::string& name) {
-        FaceIdentity identity(next_id_, name);
-        identities_.push_back(identity);
-        return next_id_++;
-    }
-
-    void add_embedding_to_identity(int id, const std::vector<float>& embedding) {
-        for (auto& identity : identities_) {
-            if (identity.id == id) {
-                identity.add_embedding(embedding);
-                break;
-            }
-        }
-    }
-
-    int recognize_face(const std::vector<float>& embedding, float threshold = 0.6f) {
-        float best_similarity = -1.0f;
-        int best_id = -1;
-
-        for (const auto& identity : identities_) {
-            for (const auto& stored_embedding : identity.embeddings) {
-                float similarity = cosine_similarity(embedding, stored_embedding);
-                if (similarity > best_similarity && similarity > threshold) {
-                    best_similarity = similarity;
-                    best_id = identity.id;
-                }
-            }
-        }
-
-        return best_id;
-    }
-
-    std::string get_identity_name(int id) {
-        for (const auto& identity : identities_) {
-            if (identity.id == id) {
-                return identity.name;
-            }
-        }
-        return "Unknown";
-    }
-
-    size_t size() const { return identities_.size(); }
+    int identity_id;   // -1 when no identity clears the threshold
+    float similarity;  // cosine similarity of the best identity
+    float margin;      // how far the decision is from flipping: to the runner-up identity, or to the threshold
 
-private:
-    float cosine_similarity(const std::vector<float>& a, const std::vector<float>& b) {
-        if (a.size() != b.size()) return -1.0f;
-
-        float dot_product = 0.0f;
-        float norm_a = 0.0f;
-        float norm_b = 0.0f;
-
-        for (size_t i = 0; i < a.size(); ++i) {
-            dot_product += a[i] * b[i];
-            norm_a += a[i] * a[i];
-            norm_b += b[i] * b[i];
-        }
-
-        if (norm_a == 0.0f || norm_b == 0.0f) return -1.0f;
-
-        return dot_product / (sqrt(norm_a) * sqrt(norm_b));
-    }
-};
\ No newline at end of file
+    FaceMatch() : identity_id(-1), similarity(-1.0f), margin(0.0f) {}
+};
@@ -0,0 +1,1223 @@
+#include "face_database.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <streambuf>
+#include "simd_dot.h"
+
+namespace {
+
+// Template rows are padded to a whole number of 64-byte lines
+constexpr size_t kRowAlignment = 16;
+constexpr size_t kQuantizedRowAlignment = 64;
+
+// Gallery file: header, section table, then sections at page-aligned offsets so that the
+// mapped matrices are aligned for SIMD loads and share whole pages between processes
+constexpr uint32_t kGalleryMagic = 0x47424446; // "FDBG"
+constexpr uint32_t kGalleryVersion = 3; // 2: identity thresholds, 3: watchlist flag
+constexpr size_t kSectionAlignment = 4096;
+
+enum GallerySectionType : uint32_t
+{
+    kSectionTemplates = 1,       // num_rows x row_stride floats
+    kSectionRowIdentities = 2,   // num_rows int32
+    kSectionIdentities = 3,      // num_identities GalleryIdentityEntry
+    kSectionNames = 4,           // name bytes, not terminated
+    kSectionIndex = 5,           // HnswIndex::Save()
+    kSectionQuantized = 6,       // num_rows x quantized_stride int8
+    kSectionQuantizedScales = 7, // num_rows floats
+};
+
+struct GalleryFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t embedding_size;
+    uint32_t row_stride;
+    uint32_t quantized_stride;
+    uint32_t num_sections;
+    uint64_t num_rows;
+    uint64_t num_identities;
+    int32_t next_id;
+    uint32_t reserved[5];
+};
+static_assert(sizeof(GalleryFileHeader) == 64, "gallery file header layout");
+
+struct GallerySection
+{
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+};
+static_assert(sizeof(GallerySection) == 24, "gallery section layout");
+
+struct GalleryIdentityEntry
+{
+    int32_t id;
+    uint32_t name_offset;
+    uint32_t name_size;
+    uint32_t flags; // kIdentityHasThreshold, kIdentityWatchlist
+    float threshold;
+};
+constexpr uint32_t kIdentityHasThreshold = 1;
+constexpr uint32_t kIdentityWatchlist = 2; // version 3
+
+// Flags a file of the given version may set; any other bit is from a newer writer
+inline uint32_t KnownIdentityFlags(uint32_t version)
+{
+    return version >= 3 ? kIdentityHasThreshold | kIdentityWatchlist : version >= 2 ? kIdentityHasThreshold : 0;
+}
+constexpr size_t kIdentityEntrySizeV1 = 12; // id and name only
+
+constexpr size_t kMaxSections = 8;
+
+// Write-ahead log: a header, then records of a fixed header and a payload (the name, or the
+// template's floats). A record cut short by a crash fails its checksum and ends the log.
+constexpr uint32_t kLogMagic = 0x4c574446; // "FDWL"
+constexpr uint32_t kLogVersion = 1;
+constexpr uint32_t kLogIdentity = 1;
+constexpr uint32_t kLogTemplate = 2;
+constexpr uint32_t kLogThreshold = 3; // payload: the threshold, or nothing to clear it
+constexpr uint32_t kLogWatchlist = 4; // payload: one byte, 1 to add and 0 to remove
+
+struct LogHeader
+{
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct LogRecord
+{
+    uint32_t type;
+    int32_t id;
+    uint32_t size; // payload bytes
+    uint32_t checksum;
+};
+
+inline uint32_t Fnv1a(const void *data, size_t size, uint32_t hash = 2166136261u)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+inline uint32_t RecordChecksum(uint32_t type, int32_t id, const void *payload, size_t size)
+{
+    const uint32_t fields[3] = {type, static_cast<uint32_t>(id), static_cast<uint32_t>(size)};
+    return Fnv1a(payload, size, Fnv1a(fields, sizeof(fields)));
+}
+
+// fsync a file or directory by path; the data must be on disk before a rename that
+// publishes it, and the rename before anything that relies on it
+bool SyncPath(const std::string& path, int flags)
+{
+    const int fd = ::open(path.c_str(), flags | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    const bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+}
+
+inline std::string ParentDirectory(const std::string& path)
+{
+    const size_t slash = path.rfind('/');
+    return slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+}
+
+// Read-only istream over mapped bytes, for HnswIndex::Load()
+class MemoryStreamBuf : public std::streambuf
+{
+public:
+    MemoryStreamBuf(const uint8_t *data, size_t size)
+    {
+        char *begin = const_cast<char *>(reinterpret_cast<const char *>(data));
+        setg(begin, begin, begin + size);
+    }
+};
+
+// Template rows per tile of a batched scan: 256 rows of 128 floats are 128 KB, which stays
+// in L2 while every query of the batch is scored against it
+constexpr size_t kBatchTileRows = 256;
+
+// 1 / |embedding|, 0 for a zero vector
+inline float InverseNorm(const float *embedding, size_t size)
+{
+    float norm = 0.0f;
+    for (size_t d = 0; d < size; d++) {
+        norm += embedding[d] * embedding[d];
+    }
+    return norm > 0.0f ? 1.0f / std::sqrt(norm) : 0.0f;
+}
+
+// Symmetric per-vector int8 quantization to [-127, 127]; returns the dequantization scale
+inline float Quantize(const float *values, size_t size, int8_t *out)
+{
+    float max_abs = 0.0f;
+    for (size_t d = 0; d < size; d++) {
+        max_abs = std::max(max_abs, std::fabs(values[d]));
+    }
+    if (max_abs == 0.0f) {
+        std::fill(out, out + size, 0);
+        return 0.0f;
+    }
+    const float scale = 127.0f / max_abs;
+    for (size_t d = 0; d < size; d++) {
+        out[d] = static_cast<int8_t>(std::lrintf(values[d] * scale));
+    }
+    return max_abs / 127.0f;
+}
+
+// Grow a buffer of rows, keeping the used elements (AlignedBuffer drops them when it grows)
+template <typename T>
+void GrowRows(AlignedBuffer<T> &buffer, size_t used, size_t count)
+{
+    AlignedBuffer<T> grown(count);
+    if (used > 0) {
+        std::memcpy(grown.data(), buffer.data(), used * sizeof(T));
+    }
+    buffer = std::move(grown);
+}
+
+// Keep the k best identities sorted, each with its best similarity
+inline void OfferHit(GalleryHit *hits, size_t &count, size_t k, int identity_id, float similarity)
+{
+    if (count == k && similarity <= hits[k - 1].similarity) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (hits[i].identity_id == identity_id) {
+            if (similarity <= hits[i].similarity) {
+                return;
+            }
+            std::memmove(hits + i, hits + i + 1, (count - i - 1) * sizeof(GalleryHit));
+            count--;
+            break;
+        }
+    }
+    size_t pos = std::min(count, k - 1);
+    while (pos > 0 && hits[pos - 1].similarity < similarity) {
+        hits[pos] = hits[pos - 1];
+        pos--;
+    }
+    hits[pos] = GalleryHit{identity_id, similarity};
+    count = std::min(count + 1, k);
+}
+
+// Best identity above threshold from the two best hits of a search
+FaceMatch MatchFromHits(const GalleryHit *hits, size_t count, float threshold)
+{
+    const float best_similarity = count > 0 ? hits[0].similarity : -1.0f;
+    const float runner_up_similarity = count > 1 ? hits[1].similarity : -1.0f;
+
+    FaceMatch match;
+    match.similarity = best_similarity;
+    if (count > 0 && best_similarity > threshold) {
+        match.identity_id = hits[0].identity_id;
+        match.margin = std::min(best_similarity - runner_up_similarity, best_similarity - threshold);
+    }
+    else {
+        match.margin = threshold - best_similarity;
+    }
+    return match;
+}
+
+} // namespace
+
+// Write-ahead log descriptor, shared by the copies of an opened gallery
+struct FaceDatabase::LogFile
+{
+    explicit LogFile(int fd) : fd(fd) {}
+    ~LogFile() { ::close(fd); }
+    int fd;
+};
+
+// int8 copy of the file rows, made by enable_quantization() when the file has none
+struct FaceDatabase::QuantizedRows
+{
+    AlignedBuffer<int8_t> rows;
+    std::vector<float> scales;
+};
+
+FaceDatabase::FaceDatabase()
+    : next_id_(0), embedding_size_(0), row_stride_(0), num_rows_(0), file_rows_(0), file_templates_(nullptr),
+      file_row_identity_(nullptr), row_capacity_(0), min_indexed_rows_(0), quantized_(false),
+      rerank_candidates_(0), quantized_stride_(0), file_quantized_(nullptr), file_quantized_scales_(nullptr),
+      watchlist_rows_(0)
+{
+}
+
+FaceDatabase::FaceDatabase(const FaceDatabase &other)
+    : identities_(other.identities_), next_id_(other.next_id_), embedding_size_(other.embedding_size_),
+      row_stride_(other.row_stride_), num_rows_(other.num_rows_), mapping_(other.mapping_),
+      file_rows_(other.file_rows_), file_templates_(other.file_templates_),
+      file_row_identity_(other.file_row_identity_), row_capacity_(other.row_capacity_),
+      row_identity_(other.row_identity_),
+      index_(other.index_ ? std::make_unique<HnswIndex>(*other.index_) : nullptr),
+      min_indexed_rows_(other.min_indexed_rows_), quantized_(other.quantized_),
+      rerank_candidates_(other.rerank_candidates_), quantized_stride_(other.quantized_stride_),
+      file_quantized_(other.file_quantized_), file_quantized_scales_(other.file_quantized_scales_),
+      file_quantized_copy_(other.file_quantized_copy_), quantized_scales_(other.quantized_scales_),
+      watchlist_row_identity_(other.watchlist_row_identity_), watchlist_rows_(other.watchlist_rows_),
+      path_(other.path_), log_(other.log_)
+{
+    // The file rows are shared as they are; enrolled ones are copied with their spare capacity
+    const size_t enrolled = num_rows_ - file_rows_;
+    GrowRows(templates_, 0, row_capacity_ * row_stride_);
+    if (enrolled > 0) {
+        std::memcpy(templates_.data(), other.templates_.data(), enrolled * row_stride_ * sizeof(float));
+    }
+    row_identity_.reserve(row_capacity_);
+    if (quantized_) {
+        GrowRows(quantized_templates_, 0, row_capacity_ * quantized_stride_);
+        if (enrolled > 0) {
+            std::memcpy(quantized_templates_.data(), other.quantized_templates_.data(),
+                        enrolled * quantized_stride_);
+        }
+        quantized_scales_.reserve(row_capacity_);
+    }
+    if (watchlist_rows_ > 0) {
+        GrowRows(watchlist_templates_, 0, other.watchlist_templates_.size());
+        std::memcpy(watchlist_templates_.data(), other.watchlist_templates_.data(),
+                    watchlist_rows_ * row_stride_ * sizeof(float));
+    }
+}
+
+FaceDatabase::~FaceDatabase() = default;
+
+int FaceDatabase::add_identity(const std::string& name)
+{
+    const int id = next_id_;
+    insert_identity(id, name);
+    if (log_) {
+        append_log(kLogIdentity, id, name.data(), name.size());
+    }
+    return id;
+}
+
+void FaceDatabase::insert_identity(int id, const std::string& name)
+{
+    identities_[id].name = name;
+    next_id_ = std::max(next_id_, id + 1);
+}
+
+void FaceDatabase::add_embedding_to_identity(int id, const std::vector<float>& embedding)
+{
+    if (add_template(id, embedding.data(), embedding.size()) && log_) {
+        append_log(kLogTemplate, id, embedding.data(), embedding.size() * sizeof(float));
+    }
+}
+
+bool FaceDatabase::add_template(int id, const float *embedding, size_t size)
+{
+    if (identities_.find(id) == identities_.end() || size == 0) {
+        return false;
+    }
+    if (embedding_size_ == 0) {
+        embedding_size_ = size;
+        row_stride_ = (embedding_size_ + kRowAlignment - 1) / kRowAlignment * kRowAlignment;
+        quantized_stride_ = (embedding_size_ + kQuantizedRowAlignment - 1) / kQuantizedRowAlignment *
+                            kQuantizedRowAlignment;
+    }
+    if (size != embedding_size_) {
+        return false;
+    }
+
+    const float inv_norm = InverseNorm(embedding, size);
+    if (inv_norm == 0.0f) {
+        return false;
+    }
+
+    // Appended after the file rows, which stay mapped
+    const size_t enrolled = num_rows_ - file_rows_;
+    reserve_rows(enrolled + 1);
+    float *row = templates_.data() + enrolled * row_stride_;
+    for (size_t d = 0; d < embedding_size_; d++) {
+        row[d] = embedding[d] * inv_norm;
+    }
+    std::fill(row + embedding_size_, row + row_stride_, 0.0f);
+    row_identity_.push_back(id);
+    if (quantized_) {
+        quantize_row(enrolled);
+    }
+    num_rows_++;
+    if (index_) {
+        index_->Add(vectors(), embedding_size_);
+    }
+    if (is_watchlist(id)) {
+        append_watchlist_row(row, id);
+    }
+    return true;
+}
+
+FaceMatch FaceDatabase::match_face(const float *embedding, size_t size, float threshold, GalleryTier tier) const
+{
+    GalleryHit hits[2];
+    const size_t count = search(embedding, size, 2, hits, tier);
+    return MatchFromHits(hits, count, count > 0 ? identity_threshold(hits[0].identity_id, threshold) : threshold);
+}
+
+size_t FaceDatabase::search_candidates(const float *embedding, size_t size, size_t k, float default_threshold,
+                                       GalleryCandidate *candidates, FaceMatch &match) const
+{
+    // The runner-up is needed for the margin even when only the best candidate is wanted
+    thread_local std::vector<GalleryHit> hits;
+    hits.resize(std::max<size_t>(k, 2));
+    const size_t count = search(embedding, size, hits.size(), hits.data());
+    const size_t returned = std::min(count, k);
+    for (size_t i = 0; i < returned; i++) {
+        auto it = identities_.find(hits[i].identity_id);
+        const bool known = it != identities_.end();
+        candidates[i].identity_id = hits[i].identity_id;
+        candidates[i].similarity = hits[i].similarity;
+        candidates[i].threshold = known && it->second.has_threshold ? it->second.threshold : default_threshold;
+        candidates[i].name = known ? std::string_view(it->second.name) : std::string_view(get_identity_name(-1));
+    }
+    match = MatchFromHits(hits.data(), count,
+                          count > 0 ? identity_threshold(hits[0].identity_id, default_threshold) : default_threshold);
+    return returned;
+}
+
+void FaceDatabase::match_faces(const float *embeddings, size_t count, size_t size, float threshold,
+                               FaceMatch *matches, GalleryTier tier) const
+{
+    thread_local std::vector<GalleryHit> hits;
+    thread_local std::vector<size_t> hit_counts;
+    hits.resize(count * 2);
+    hit_counts.resize(count);
+    search_batch(embeddings, count, size, 2, hits.data(), hit_counts.data(), tier);
+    for (size_t i = 0; i < count; i++) {
+        const GalleryHit *face_hits = hits.data() + i * 2;
+        matches[i] = MatchFromHits(face_hits, hit_counts[i],
+                                   hit_counts[i] > 0 ? identity_threshold(face_hits[0].identity_id, threshold)
+                                                     : threshold);
+    }
+}
+
+size_t FaceDatabase::search(const float *embedding, size_t size, size_t k, GalleryHit *hits,
+                            GalleryTier tier) const
+{
+    if (k == 0 || num_rows_ == 0 || size != embedding_size_) {
+        return 0;
+    }
+    // The watchlist is small enough that an exact scan beats the graph and the int8 rows
+    if (tier == GalleryTier::kWatchlist) {
+        const RowSegment watchlist = {watchlist_templates_.data(), watchlist_row_identity_.data(), watchlist_rows_};
+        return scan_rows(&watchlist, 1, embedding, k, hits);
+    }
+    if (index_ && num_rows_ >= min_indexed_rows_) {
+        return search_indexed(embedding, k, hits);
+    }
+    if (quantized_ && num_rows_ > rerank_candidates_) {
+        size_t count;
+        search_quantized(embedding, 1, k, hits, &count);
+        return count;
+    }
+    return search_exact(embedding, size, k, hits);
+}
+
+size_t FaceDatabase::search_indexed(const float *embedding, size_t k, GalleryHit *hits) const
+{
+    const size_t size = embedding_size_;
+    const float inv_norm = InverseNorm(embedding, size);
+    if (inv_norm == 0.0f) {
+        return 0;
+    }
+
+    // The graph returns templates; fold its whole candidate list into identities
+    thread_local std::vector<uint32_t> rows;
+    thread_local std::vector<float> similarities;
+    const size_t candidates = std::max(k, index_->EfSearch());
+    rows.resize(candidates);
+    similarities.resize(candidates);
+    const size_t found = index_->Search(vectors(), size, embedding, candidates, rows.data(), similarities.data());
+    size_t count = 0;
+    for (size_t i = 0; i < found; i++) {
+        OfferHit(hits, count, k, template_id(rows[i]), similarities[i] * inv_norm);
+    }
+    return count;
+}
+
+void FaceDatabase::search_quantized(const float *embeddings, size_t count, size_t k, GalleryHit *hits,
+                                    size_t *hit_counts) const
+{
+    const size_t size = embedding_size_;
+    const size_t stride = quantized_stride_;
+    const size_t rerank = rerank_candidates_;
+
+    // Queries quantized into padded rows like the templates; zero queries get no hits
+    thread_local AlignedBuffer<int8_t> queries;
+    thread_local std::vector<float> inv_norms;
+    queries.Resize(count * stride);
+    inv_norms.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        const float *embedding = embeddings + i * size;
+        int8_t *query = queries.data() + i * stride;
+        inv_norms[i] = InverseNorm(embedding, size);
+        Quantize(embedding, size, query);
+        std::fill(query + size, query + stride, 0);
+        hit_counts[i] = 0;
+    }
+
+    // Coarse pass over the int8 rows, file rows then enrolled ones: every query keeps its best
+    // rerank candidates in a min-heap. The query scale is the same for every row, so only the
+    // row scales are applied. Tiles of rows are scored against the whole batch while in L1.
+    using Candidate = std::pair<float, uint32_t>;
+    thread_local std::vector<Candidate> candidates;
+    thread_local std::vector<size_t> num_candidates;
+    candidates.resize(count * rerank);
+    num_candidates.assign(count, 0);
+    auto offer = [&](size_t i, float score, uint32_t row) {
+        Candidate *heap = candidates.data() + i * rerank;
+        size_t &used = num_candidates[i];
+        if (used < rerank) {
+            heap[used++] = Candidate(score, row);
+            std::push_heap(heap, heap + used, std::greater<Candidate>());
+        }
+        else if (score > heap[0].first) {
+            std::pop_heap(heap, heap + used, std::greater<Candidate>());
+            heap[used - 1] = Candidate(score, row);
+            std::push_heap(heap, heap + used, std::greater<Candidate>());
+        }
+    };
+    auto scan = [&](const int8_t *rows, const float *scales, size_t num_rows, uint32_t first) {
+        int32_t dots[kDotRowBlock];
+        for (size_t tile = 0; tile < num_rows; tile += kBatchTileRows) {
+            const size_t tile_end = std::min(num_rows, tile + kBatchTileRows);
+            for (size_t i = 0; i < count; i++) {
+                if (inv_norms[i] == 0.0f) {
+                    continue;
+                }
+                const int8_t *query = queries.data() + i * stride;
+                size_t row = tile;
+                for (; row + kDotRowBlock <= tile_end; row += kDotRowBlock) {
+                    DotRowsInt8<kDotRowBlock>(query, rows + row * stride, stride, dots);
+                    for (size_t r = 0; r < kDotRowBlock; r++) {
+                        offer(i, dots[r] * scales[row + r], first + static_cast<uint32_t>(row + r));
+                    }
+                }
+                for (; row < tile_end; row++) {
+                    DotRowsInt8<1>(query, rows + row * stride, stride, dots);
+                    offer(i, dots[0] * scales[row], first + static_cast<uint32_t>(row));
+                }
+            }
+        }
+    };
+    scan(file_quantized_, file_quantized_scales_, file_rows_, 0);
+    scan(quantized_templates_.data(), quantized_scales_.data(), num_rows_ - file_rows_,
+         static_cast<uint32_t>(file_rows_));
+
+    // Exact float re-ranking of the survivors: the only float rows a quantized search reads
+    for (size_t i = 0; i < count; i++) {
+        const float *embedding = embeddings + i * size;
+        const Candidate *heap = candidates.data() + i * rerank;
+        for (size_t c = 0; c < num_candidates[i]; c++) {
+            float dot;
+            DotRows<1>(embedding, size, template_row(heap[c].second), row_stride_, &dot);
+            OfferHit(hits + i * k, hit_counts[i], k, template_id(heap[c].second), dot * inv_norms[i]);
+        }
+    }
+}
+
+size_t FaceDatabase::search_exact(const float *embedding, size_t size, size_t k, GalleryHit *hits) const
+{
+    if (k == 0 || num_rows_ == 0 || size != embedding_size_) {
+        return 0;
+    }
+    RowSegment segments[2];
+    return scan_rows(segments, row_segments(segments), embedding, k, hits);
+}
+
+size_t FaceDatabase::row_segments(RowSegment *segments) const
+{
+    size_t count = 0;
+    if (file_rows_ > 0) {
+        segments[count++] = {file_templates_, file_row_identity_, file_rows_};
+    }
+    if (num_rows_ > file_rows_) {
+        segments[count++] = {templates_.data(), row_identity_.data(), num_rows_ - file_rows_};
+    }
+    return count;
+}
+
+size_t FaceDatabase::scan_rows(const RowSegment *segments, size_t num_segments, const float *embedding, size_t k,
+                               GalleryHit *hits) const
+{
+    const size_t size = embedding_size_;
+
+    // Rows are unit length, so only the query norm is left to divide by
+    const float inv_norm = InverseNorm(embedding, size);
+    if (inv_norm == 0.0f) {
+        return 0;
+    }
+
+    size_t count = 0;
+    float dots[kDotRowBlock];
+    for (size_t s = 0; s < num_segments; s++) {
+        const float *rows = segments[s].rows;
+        const int32_t *row_ids = segments[s].row_ids;
+        const size_t num_rows = segments[s].count;
+        size_t row = 0;
+        for (; row + kDotRowBlock <= num_rows; row += kDotRowBlock) {
+            DotRows<kDotRowBlock>(embedding, size, rows + row * row_stride_, row_stride_, dots);
+            for (size_t r = 0; r < kDotRowBlock; r++) {
+                OfferHit(hits, count, k, row_ids[row + r], dots[r] * inv_norm);
+            }
+        }
+        for (; row < num_rows; row++) {
+            DotRows<1>(embedding, size, rows + row * row_stride_, row_stride_, dots);
+            OfferHit(hits, count, k, row_ids[row], dots[0] * inv_norm);
+        }
+    }
+    return count;
+}
+
+void FaceDatabase::search_batch(const float *embeddings, size_t count, size_t size, size_t k, GalleryHit *hits,
+                                size_t *hit_counts, GalleryTier tier) const
+{
+    if (k == 0 || num_rows_ == 0 || size != embedding_size_) {
+        std::fill(hit_counts, hit_counts + count, 0);
+        return;
+    }
+    if (tier == GalleryTier::kWatchlist) {
+        const RowSegment watchlist = {watchlist_templates_.data(), watchlist_row_identity_.data(), watchlist_rows_};
+        scan_rows_batch(&watchlist, 1, embeddings, count, k, hits, hit_counts);
+        return;
+    }
+    // The graph walk of each query touches different rows. A quantized gallery is scanned as
+    // int8 rows for the whole batch, so its float rows stay off the hot path there too.
+    const bool indexed = index_ && num_rows_ >= min_indexed_rows_;
+    if (indexed || count < 2) {
+        for (size_t i = 0; i < count; i++) {
+            hit_counts[i] = search(embeddings + i * size, size, k, hits + i * k);
+        }
+        return;
+    }
+    if (quantized_ && num_rows_ > rerank_candidates_) {
+        search_quantized(embeddings, count, k, hits, hit_counts);
+        return;
+    }
+    RowSegment segments[2];
+    scan_rows_batch(segments, row_segments(segments), embeddings, count, k, hits, hit_counts);
+}
+
+void FaceDatabase::scan_rows_batch(const RowSegment *segments, size_t num_segments, const float *embeddings,
+                                   size_t count, size_t k, GalleryHit *hits, size_t *hit_counts) const
+{
+    const size_t size = embedding_size_;
+    const size_t stride = row_stride_;
+
+    // Queries normalized into padded rows like the templates, so the kernel needs no tail
+    // handling and its dot products are the similarities. Zero queries get no hits.
+    thread_local AlignedBuffer<float> queries;
+    thread_local std::vector<uint8_t> valid;
+    queries.Resize(count * stride);
+    valid.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        const float *embedding = embeddings + i * size;
+        const float inv_norm = InverseNorm(embedding, size);
+        float *query = queries.data() + i * stride;
+        for (size_t d = 0; d < size; d++) {
+            query[d] = embedding[d] * inv_norm;
+        }
+        std::fill(query + size, query + stride, 0.0f);
+        valid[i] = inv_norm > 0.0f;
+        hit_counts[i] = 0;
+    }
+
+    // Similarity matrix one tile of rows at a time: count x kBatchTileRows scores
+    thread_local AlignedBuffer<float> scores;
+    scores.Resize(count * kBatchTileRows);
+    // One segment at a time: tiles do not span the file rows and the enrolled ones
+    for (size_t s = 0; s < num_segments; s++) {
+        const float *rows = segments[s].rows;
+        const int32_t *row_ids = segments[s].row_ids;
+        const size_t num_rows = segments[s].count;
+        for (size_t tile = 0; tile < num_rows; tile += kBatchTileRows) {
+            const size_t tile_rows = std::min(kBatchTileRows, num_rows - tile);
+            const float *tile_data = rows + tile * stride;
+
+            size_t q = 0;
+            for (; q + kDotQueryBlock <= count; q += kDotQueryBlock) {
+                const float *block = queries.data() + q * stride;
+                float *out = scores.data() + q * kBatchTileRows;
+                size_t r = 0;
+                for (; r + kDotRowBlock <= tile_rows; r += kDotRowBlock) {
+                    DotBlock<kDotQueryBlock, kDotRowBlock>(block, tile_data + r * stride, stride, out + r,
+                                                           kBatchTileRows);
+                }
+                for (; r < tile_rows; r++) {
+                    DotBlock<kDotQueryBlock, 1>(block, tile_data + r * stride, stride, out + r, kBatchTileRows);
+                }
+            }
+            for (; q < count; q++) {
+                const float *query = queries.data() + q * stride;
+                float *out = scores.data() + q * kBatchTileRows;
+                size_t r = 0;
+                for (; r + kDotRowBlock <= tile_rows; r += kDotRowBlock) {
+                    DotBlock<1, kDotRowBlock>(query, tile_data + r * stride, stride, out + r, kBatchTileRows);
+                }
+                for (; r < tile_rows; r++) {
+                    DotBlock<1, 1>(query, tile_data + r * stride, stride, out + r, kBatchTileRows);
+                }
+            }
+
+            for (size_t i = 0; i < count; i++) {
+                if (!valid[i]) {
+                    continue;
+                }
+                const float *row_scores = scores.data() + i * kBatchTileRows;
+                for (size_t r = 0; r < tile_rows; r++) {
+                    OfferHit(hits + i * k, hit_counts[i], k, row_ids[tile + r], row_scores[r]);
+                }
+            }
+        }
+    }
+}
+
+void FaceDatabase::enable_index(size_t m, size_t ef_construction, size_t ef_search, size_t min_indexed_templates)
+{
+    min_indexed_rows_ = min_indexed_templates;
+    // An index loaded with the gallery file is kept when it has the requested links
+    if (index_ && index_->M() == m && index_->Size() == num_rows_) {
+        index_->SetEfSearch(ef_search);
+        return;
+    }
+    index_ = std::make_unique<HnswIndex>(m, ef_construction, ef_search);
+    for (size_t row = 0; row < num_rows_; row++) {
+        index_->Add(vectors(), embedding_size_);
+    }
+}
+
+void FaceDatabase::set_index_ef_search(size_t ef_search)
+{
+    if (index_) {
+        index_->SetEfSearch(ef_search);
+    }
+}
+
+void FaceDatabase::enable_quantization(size_t rerank_candidates)
+{
+    rerank_candidates_ = std::max<size_t>(rerank_candidates, 1);
+    if (quantized_) {
+        return;
+    }
+    quantized_ = true;
+    // The file rows never change, so the copies of the database share their int8 rows
+    if (file_rows_ > 0) {
+        auto file_quantized = std::make_shared<QuantizedRows>();
+        file_quantized->rows.Resize(file_rows_ * quantized_stride_);
+        file_quantized->scales.resize(file_rows_);
+        for (size_t row = 0; row < file_rows_; row++) {
+            file_quantized->scales[row] = Quantize(file_templates_ + row * row_stride_, embedding_size_,
+                                                   file_quantized->rows.data() + row * quantized_stride_);
+        }
+        file_quantized_ = file_quantized->rows.data();
+        file_quantized_scales_ = file_quantized->scales.data();
+        file_quantized_copy_ = std::move(file_quantized);
+        if (mapping_) {
+            mapping_->AdviseRandom(reinterpret_cast<const uint8_t *>(file_templates_) - mapping_->Data(),
+                                   file_rows_ * row_stride_ * sizeof(float));
+        }
+    }
+    if (row_capacity_ > 0) {
+        quantized_templates_.Resize(row_capacity_ * quantized_stride_);
+        quantized_scales_.reserve(row_capacity_);
+    }
+    for (size_t row = 0; row < num_rows_ - file_rows_; row++) {
+        quantize_row(row);
+    }
+}
+
+void FaceDatabase::quantize_row(size_t row)
+{
+    int8_t *out = quantized_templates_.data() + row * quantized_stride_;
+    quantized_scales_.push_back(Quantize(templates_.data() + row * row_stride_, embedding_size_, out));
+    std::fill(out + embedding_size_, out + quantized_stride_, 0);
+}
+
+void FaceDatabase::set_identity_threshold(int id, float threshold)
+{
+    if (apply_threshold(id, true, threshold) && log_) {
+        append_log(kLogThreshold, id, &threshold, sizeof(threshold));
+    }
+}
+
+void FaceDatabase::clear_identity_threshold(int id)
+{
+    if (apply_threshold(id, false, 0.0f) && log_) {
+        append_log(kLogThreshold, id, nullptr, 0);
+    }
+}
+
+bool FaceDatabase::apply_threshold(int id, bool has_threshold, float threshold)
+{
+    auto it = identities_.find(id);
+    if (it == identities_.end()) {
+        return false;
+    }
+    it->second.has_threshold = has_threshold;
+    it->second.threshold = has_threshold ? threshold : 0.0f;
+    return true;
+}
+
+float FaceDatabase::identity_threshold(int id, float default_threshold) const
+{
+    auto it = identities_.find(id);
+    return it != identities_.end() && it->second.has_threshold ? it->second.threshold : default_threshold;
+}
+
+void FaceDatabase::set_watchlist(int id, bool watchlist)
+{
+    if (apply_watchlist(id, watchlist) && log_) {
+        const uint8_t flag = watchlist ? 1 : 0;
+        append_log(kLogWatchlist, id, &flag, sizeof(flag));
+    }
+}
+
+bool FaceDatabase::is_watchlist(int id) const
+{
+    auto it = identities_.find(id);
+    return it != identities_.end() && it->second.watchlist;
+}
+
+bool FaceDatabase::apply_watchlist(int id, bool watchlist)
+{
+    auto it = identities_.find(id);
+    if (it == identities_.end()) {
+        return false;
+    }
+    if (it->second.watchlist == watchlist) {
+        return true;
+    }
+    it->second.watchlist = watchlist;
+
+    if (watchlist) {
+        for (size_t row = 0; row < num_rows_; row++) {
+            if (template_id(row) == id) {
+                append_watchlist_row(template_row(row), id);
+            }
+        }
+        return true;
+    }
+    // Compact the remaining watchlist rows in place
+    size_t kept = 0;
+    for (size_t row = 0; row < watchlist_rows_; row++) {
+        if (watchlist_row_identity_[row] == id) {
+            continue;
+        }
+        if (kept != row) {
+            std::memcpy(watchlist_templates_.data() + kept * row_stride_,
+                        watchlist_templates_.data() + row * row_stride_, row_stride_ * sizeof(float));
+            watchlist_row_identity_[kept] = watchlist_row_identity_[row];
+        }
+        kept++;
+    }
+    watchlist_rows_ = kept;
+    watchlist_row_identity_.resize(kept);
+    return true;
+}
+
+void FaceDatabase::rebuild_watchlist()
+{
+    watchlist_rows_ = 0;
+    watchlist_row_identity_.clear();
+    for (size_t row = 0; row < num_rows_; row++) {
+        if (is_watchlist(template_id(row))) {
+            append_watchlist_row(template_row(row), template_id(row));
+        }
+    }
+}
+
+void FaceDatabase::append_watchlist_row(const float *row, int id)
+{
+    if ((watchlist_rows_ + 1) * row_stride_ > watchlist_templates_.size()) {
+        const size_t capacity = std::max<size_t>(watchlist_rows_ * 2, 64);
+        GrowRows(watchlist_templates_, watchlist_rows_ * row_stride_, capacity * row_stride_);
+    }
+    std::memcpy(watchlist_templates_.data() + watchlist_rows_ * row_stride_, row, row_stride_ * sizeof(float));
+    watchlist_row_identity_.push_back(id);
+    watchlist_rows_++;
+}
+
+const std::string& FaceDatabase::get_identity_name(int id) const
+{
+    static const std::string unknown("Unknown");
+    auto it = identities_.find(id);
+    return it != identities_.end() ? it->second.name : unknown;
+}
+
+void FaceDatabase::reserve_rows(size_t rows)
+{
+    if (rows <= row_capacity_) {
+        return;
+    }
+    const size_t enrolled = num_rows_ - file_rows_;
+    const size_t capacity = std::max(rows, std::max<size_t>(row_capacity_ * 2, 64));
+    GrowRows(templates_, enrolled * row_stride_, capacity * row_stride_);
+    if (quantized_) {
+        GrowRows(quantized_templates_, enrolled * quantized_stride_, capacity * quantized_stride_);
+        quantized_scales_.reserve(capacity);
+    }
+    row_capacity_ = capacity;
+    row_identity_.reserve(capacity);
+}
+
+void FaceDatabase::clear()
+{
+    identities_.clear();
+    next_id_ = 0;
+    embedding_size_ = row_stride_ = quantized_stride_ = 0;
+    num_rows_ = file_rows_ = row_capacity_ = 0;
+    mapping_.reset();
+    file_templates_ = nullptr;
+    file_row_identity_ = nullptr;
+    templates_ = AlignedBuffer<float>();
+    row_identity_.clear();
+    index_.reset();
+    quantized_ = false;
+    file_quantized_ = nullptr;
+    file_quantized_scales_ = nullptr;
+    file_quantized_copy_.reset();
+    quantized_templates_ = AlignedBuffer<int8_t>();
+    quantized_scales_.clear();
+    watchlist_templates_ = AlignedBuffer<float>();
+    watchlist_row_identity_.clear();
+    watchlist_rows_ = 0;
+    path_.clear();
+    log_.reset();
+}
+
+bool FaceDatabase::save(const std::string& path) const
+{
+    const std::string temp_path = path + ".tmp";
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Cannot write gallery file " << temp_path << std::endl;
+        return false;
+    }
+
+    // Identity table ordered by ID, names packed behind it
+    std::vector<int> ids;
+    ids.reserve(identities_.size());
+    for (const auto &entry : identities_) {
+        ids.push_back(entry.first);
+    }
+    std::sort(ids.begin(), ids.end());
+    std::vector<GalleryIdentityEntry> identities;
+    std::string names;
+    for (int id : ids) {
+        const Identity &identity = identities_.at(id);
+        identities.push_back({id, static_cast<uint32_t>(names.size()), static_cast<uint32_t>(identity.name.size()),
+                              (identity.has_threshold ? kIdentityHasThreshold : 0u) |
+                                  (identity.watchlist ? kIdentityWatchlist : 0u),
+                              identity.threshold});
+        names += identity.name;
+    }
+
+    GalleryFileHeader header = {};
+    header.magic = kGalleryMagic;
+    header.version = kGalleryVersion;
+    header.embedding_size = static_cast<uint32_t>(embedding_size_);
+    header.row_stride = static_cast<uint32_t>(row_stride_);
+    header.quantized_stride = static_cast<uint32_t>(quantized_stride_);
+    header.num_rows = num_rows_;
+    header.num_identities = identities.size();
+    header.next_id = next_id_;
+    header.num_sections = 4 + (index_ ? 1 : 0) + (quantized_ ? 2 : 0);
+
+    // Header and section table are written last, once the offsets are known
+    GallerySection sections[kMaxSections] = {};
+    size_t num_sections = 0;
+    size_t offset = sizeof(header) + header.num_sections * sizeof(GallerySection);
+    out.write(std::string(offset, '\0').data(), offset);
+    auto begin_section = [&](uint32_t type) {
+        const size_t aligned = (offset + kSectionAlignment - 1) / kSectionAlignment * kSectionAlignment;
+        out.write(std::string(aligned - offset, '\0').data(), aligned - offset);
+        sections[num_sections] = {type, 0, aligned, 0};
+        offset = aligned;
+    };
+    auto end_section = [&]() {
+        const size_t end = static_cast<size_t>(out.tellp());
+        sections[num_sections++].size = end - offset;
+        offset = end;
+    };
+    auto write_section = [&](uint32_t type, const void *data, size_t size) {
+        begin_section(type);
+        out.write(static_cast<const char *>(data), size);
+        end_section();
+    };
+    // Row sections are merged here: the file rows, then those enrolled after them
+    const size_t enrolled = num_rows_ - file_rows_;
+    auto write_rows = [&](uint32_t type, const void *file_data, const void *enrolled_data, size_t row_size) {
+        begin_section(type);
+        if (file_rows_ > 0) {
+            out.write(static_cast<const char *>(file_data), file_rows_ * row_size);
+        }
+        if (enrolled > 0) {
+            out.write(static_cast<const char *>(enrolled_data), enrolled * row_size);
+        }
+        end_section();
+    };
+
+    write_rows(kSectionTemplates, file_templates_, templates_.data(), row_stride_ * sizeof(float));
+    write_rows(kSectionRowIdentities, file_row_identity_, row_identity_.data(), sizeof(int32_t));
+    write_section(kSectionIdentities, identities.data(), identities.size() * sizeof(GalleryIdentityEntry));
+    write_section(kSectionNames, names.data(), names.size());
+    if (index_) {
+        begin_section(kSectionIndex);
+        index_->Save(out);
+        end_section();
+    }
+    if (quantized_) {
+        write_rows(kSectionQuantized, file_quantized_, quantized_templates_.data(), quantized_stride_);
+        write_rows(kSectionQuantizedScales, file_quantized_scales_, quantized_scales_.data(), sizeof(float));
+    }
+
+    out.seekp(0);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(sections), num_sections * sizeof(GallerySection));
+    out.close();
+    if (!out || !SyncPath(temp_path, O_RDONLY) || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "Cannot write gallery file " << path << std::endl;
+        std::remove(temp_path.c_str());
+        return false;
+    }
+    // Until the rename is durable a crash can bring back the old file, which still needs the log
+    if (!SyncPath(ParentDirectory(path), O_RDONLY | O_DIRECTORY)) {
+        std::cerr << "Cannot sync the directory of gallery file " << path << std::endl;
+        return false;
+    }
+
+    // The file now holds everything logged since the previous one
+    if (path == path_ && log_ && (ftruncate(log_->fd, sizeof(LogHeader)) != 0 || ::fsync(log_->fd) != 0)) {
+        std::cerr << "Cannot reset gallery log " << path << ".wal" << std::endl;
+    }
+    return true;
+}
+
+bool FaceDatabase::open(const std::string& path)
+{
+    clear();
+    auto mapping = std::make_shared<MappedFile>();
+    if (mapping->Open(path)) {
+        if (!map_file(std::move(mapping))) {
+            std::cerr << "Invalid gallery file " << path << std::endl;
+            clear();
+            return false;
+        }
+    }
+    else if (::access(path.c_str(), F_OK) == 0) {
+        std::cerr << "Cannot map gallery file " << path << std::endl;
+        return false;
+    }
+
+    if (!replay_log(path + ".wal")) {
+        clear();
+        return false;
+    }
+    path_ = path;
+    return true;
+}
+
+bool FaceDatabase::map_file(std::shared_ptr<const MappedFile> mapping)
+{
+    const uint8_t *data = mapping->Data();
+    const size_t file_size = mapping->Size();
+    GalleryFileHeader header;
+    if (file_size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.magic != kGalleryMagic || header.version < 1 || header.version > kGalleryVersion ||
+        header.num_sections > kMaxSections ||
+        sizeof(header) + header.num_sections * sizeof(GallerySection) > file_size) {
+        return false;
+    }
+    const size_t size = header.embedding_size;
+    if (header.row_stride != (size + kRowAlignment - 1) / kRowAlignment * kRowAlignment ||
+        header.quantized_stride !=
+            (size + kQuantizedRowAlignment - 1) / kQuantizedRowAlignment * kQuantizedRowAlignment ||
+        (header.num_rows > 0 && size == 0)) {
+        return false;
+    }
+
+    // Every section must lie inside the file at an aligned offset and have its expected size
+    GallerySection sections[kMaxSections];
+    std::memcpy(sections, data + sizeof(header), header.num_sections * sizeof(GallerySection));
+    auto find = [&](uint32_t type) -> const GallerySection * {
+        for (size_t i = 0; i < header.num_sections; i++) {
+            if (sections[i].type == type) {
+                const GallerySection &section = sections[i];
+                const bool inside = section.offset % kSectionAlignment == 0 && section.offset <= file_size &&
+                                    section.size <= file_size - section.offset;
+                return inside ? &section : nullptr;
+            }
+        }
+        return nullptr;
+    };
+    const size_t num_rows = header.num_rows;
+    const size_t entry_size = header.version >= 2 ? sizeof(GalleryIdentityEntry) : kIdentityEntrySizeV1;
+    const GallerySection *templates = find(kSectionTemplates);
+    const GallerySection *row_ids = find(kSectionRowIdentities);
+    const GallerySection *identities = find(kSectionIdentities);
+    const GallerySection *names = find(kSectionNames);
+    if (!templates || templates->size != num_rows * header.row_stride * sizeof(float) || !row_ids ||
+        row_ids->size != num_rows * sizeof(int32_t) || !identities ||
+        identities->size != header.num_identities * entry_size || !names) {
+        return false;
+    }
+
+    for (size_t i = 0; i < header.num_identities; i++) {
+        GalleryIdentityEntry entry = {};
+        std::memcpy(&entry, data + identities->offset + i * entry_size, entry_size);
+        if (entry.name_offset > names->size || entry.name_size > names->size - entry.name_offset ||
+            (entry.flags & ~KnownIdentityFlags(header.version)) != 0) {
+            return false;
+        }
+        Identity &identity = identities_[entry.id];
+        identity.name.assign(reinterpret_cast<const char *>(data + names->offset + entry.name_offset),
+                             entry.name_size);
+        identity.has_threshold = (entry.flags & kIdentityHasThreshold) != 0;
+        identity.threshold = entry.threshold;
+        identity.watchlist = (entry.flags & kIdentityWatchlist) != 0;
+    }
+    next_id_ = header.next_id;
+
+    if (const GallerySection *index = find(kSectionIndex)) {
+        MemoryStreamBuf buffer(data + index->offset, index->size);
+        std::istream in(&buffer);
+        index_ = std::make_unique<HnswIndex>();
+        if (!index_->Load(in) || index_->Size() != num_rows) {
+            return false;
+        }
+        min_indexed_rows_ = 0;
+    }
+
+    const GallerySection *quantized = find(kSectionQuantized);
+    const GallerySection *scales = find(kSectionQuantizedScales);
+    if (quantized && scales && quantized->size == num_rows * header.quantized_stride &&
+        scales->size == num_rows * sizeof(float)) {
+        quantized_ = true;
+        rerank_candidates_ = 64;
+        file_quantized_ = reinterpret_cast<const int8_t *>(data + quantized->offset);
+        file_quantized_scales_ = reinterpret_cast<const float *>(data + scales->offset);
+        // Searches scan the int8 rows; the float ones are only read for a few candidates
+        mapping->AdviseRandom(templates->offset, templates->size);
+    }
+
+    // The templates are not read here; their pages load on the first search
+    embedding_size_ = size;
+    row_stride_ = header.row_stride;
+    quantized_stride_ = header.quantized_stride;
+    num_rows_ = file_rows_ = num_rows;
+    file_templates_ = reinterpret_cast<const float *>(data + templates->offset);
+    file_row_identity_ = reinterpret_cast<const int32_t *>(data + row_ids->offset);
+    mapping_ = std::move(mapping);
+
+    // The watchlist rows are copied out of the mapping: the tier must not page in on an alert
+    rebuild_watchlist();
+    return true;
+}
+
+bool FaceDatabase::replay_log(const std::string& log_path)
+{
+    int fd = ::open(log_path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        std::cerr << "Cannot open gallery log " << log_path << ": " << std::strerror(errno) << std::endl;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    std::vector<uint8_t> log(static_cast<size_t>(info.st_size));
+    if (!log.empty() && pread(fd, log.data(), log.size(), 0) != static_cast<ssize_t>(log.size())) {
+        std::cerr << "Cannot read gallery log " << log_path << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    LogHeader header = {kLogMagic, kLogVersion};
+    if (log.size() < sizeof(header)) {
+        // New (or cut short before its first record): start it over
+        if (ftruncate(fd, 0) != 0 || ::write(fd, &header, sizeof(header)) != sizeof(header)) {
+            std::cerr << "Cannot write gallery log " << log_path << std::endl;
+            ::close(fd);
+            return false;
+        }
+        log_ = std::make_shared<LogFile>(fd);
+        return true;
+    }
+    std::memcpy(&header, log.data(), sizeof(header));
+    if (header.magic != kLogMagic || header.version != kLogVersion) {
+        std::cerr << "Invalid gallery log " << log_path << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    size_t offset = sizeof(header);
+    while (log.size() - offset >= sizeof(LogRecord)) {
+        LogRecord record;
+        std::memcpy(&record, log.data() + offset, sizeof(record));
+        const uint8_t *payload = log.data() + offset + sizeof(record);
+        if (record.size > log.size() - offset - sizeof(record) ||
+            record.checksum != RecordChecksum(record.type, record.id, payload, record.size)) {
+            break;
+        }
+        if (record.type == kLogIdentity) {
+            insert_identity(record.id, std::string(reinterpret_cast<const char *>(payload), record.size));
+        }
+        else if (record.type == kLogTemplate) {
+            std::vector<float> embedding(record.size / sizeof(float));
+            std::memcpy(embedding.data(), payload, embedding.size() * sizeof(float));
+            add_template(record.id, embedding.data(), embedding.size());
+        }
+        else if (record.type == kLogThreshold) {
+            float threshold = 0.0f;
+            if (record.size == sizeof(threshold)) {
+                std::memcpy(&threshold, payload, sizeof(threshold));
+            }
+            apply_threshold(record.id, record.size == sizeof(threshold), threshold);
+        }
+        else if (record.type == kLogWatchlist && record.size == 1) {
+            apply_watchlist(record.id, payload[0] != 0);
+        }
+        offset += sizeof(record) + record.size;
+    }
+
+    // Drop a record torn by a crash, so appends continue from the last complete one
+    if (offset < log.size() && ftruncate(fd, static_cast<off_t>(offset)) != 0) {
+        std::cerr << "Cannot truncate gallery log " << log_path << std::endl;
+        ::close(fd);
+        return false;
+    }
+    log_ = std::make_shared<LogFile>(fd);
+    return true;
+}
+
+void FaceDatabase::append_log(uint32_t type, int id, const void *payload, size_t bytes)
+{
+    // One write per record, so a crash can only tear the last one
+    LogRecord record = {type, id, static_cast<uint32_t>(bytes), RecordChecksum(type, id, payload, bytes)};
+    std::vector<uint8_t> buffer(sizeof(record) + bytes);
+    std::memcpy(buffer.data(), &record, sizeof(record));
+    if (bytes > 0) {
+        std::memcpy(buffer.data() + sizeof(record), payload, bytes);
+    }
+    if (::write(log_->fd, buffer.data(), buffer.size()) != static_cast<ssize_t>(buffer.size())) {
+        std::cerr << "Cannot append to gallery log " << path_ << ".wal" << std::endl;
+    }
+}
@@ -0,0 +1,292 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "aligned_buffer.h"
+#include "face_core.h"
+#include "hnsw_index.h"
+#include "mapped_file.h"
+
+// One identity found by a gallery search
+struct GalleryHit
+{
+    int identity_id;
+    float similarity; // best cosine similarity over the identity's templates
+};
+
+// Templates a search covers: every template, or only those of the watchlist identities
+enum class GalleryTier
+{
+    kAll,
+    kWatchlist,
+};
+
+// One identity of a top-k search, with everything needed to decide on it
+struct GalleryCandidate
+{
+    int identity_id;
+    float similarity;
+    float threshold;       // the identity's own threshold, or the default
+    std::string_view name; // valid as long as the database (or the snapshot holding it)
+};
+
+/**
+ * @brief Gallery of enrolled identities and their face templates.
+ *
+ * Templates are stored L2-normalized as the rows of one 64-byte aligned, row-major matrix
+ * (rows padded to 16 floats, padding zeroed) with a parallel array of identity IDs, so a
+ * search is a single pass of dot products over contiguous memory, 4 rows at a time with
+ * AVX-512 or AVX2 FMAs, and the query norm is applied once. The best identities are kept
+ * in a small sorted list while scanning (top-k by identity). Names live in an ID -> name map.
+ *
+ * Large galleries can add an HNSW index over the same rows, kept up to date as templates
+ * are added; searches then visit a few thousand rows instead of all of them. Without an
+ * index, an int8 copy of the rows (per-row scale, 4x smaller) can take the full scan: it
+ * picks candidates with VNNI/AVX2 integer dot products, which are re-ranked exactly in float.
+ * Single and batched searches then read the float rows of the candidates only; those of a
+ * gallery file stay in its mapping, excluded from readahead, while an in-memory gallery
+ * keeps both copies resident. All faces of a frame can be matched in one batch, which reads
+ * the gallery (its int8 rows, if any) once.
+ *
+ * Identities can be put on a watchlist. Their templates are also kept as a separate small
+ * matrix (a few hundred KB for 500 identities, so it stays in L2/L3), which searches of the
+ * watchlist tier scan exactly, at a cost independent of the size of the full gallery.
+ *
+ * A gallery can be saved to and opened from a gallery file: a versioned binary layout with
+ * page-aligned sections for the template matrix, row identities, the identity table, names
+ * and, when enabled, the HNSW graph and the int8 rows. open() maps the file read-only and
+ * searches read the mapped pages in place, so startup does not read the templates and every
+ * process opening the file shares one copy in the page cache. Enrollments after open() are
+ * appended to a write-ahead log next to the file (<path>.wal) and replayed by the next
+ * open(). Their rows follow the file's in private memory, so neither replaying the log nor
+ * enrolling copies the mapped rows. The log is folded back into the file offline
+ * (gallery_compact), with no enrolling process running.
+ *
+ * Searches are const and safe to run concurrently; enrollment is not.
+ */
+class FaceDatabase
+{
+public:
+    FaceDatabase();
+    ~FaceDatabase();
+
+    /** @brief Copy the gallery; copies share the mapped file and the write-ahead log. */
+    FaceDatabase(const FaceDatabase &other);
+    FaceDatabase &operator=(const FaceDatabase &) = delete;
+
+    /** @brief Add a new identity. @return Its ID. */
+    int add_identity(const std::string& name);
+
+    /**
+     * @brief Add a template to an existing identity. The first template sets the embedding size;
+     * templates of another size, of zero norm or for unknown identities are ignored.
+     */
+    void add_embedding_to_identity(int id, const std::vector<float>& embedding);
+
+    /** @brief Best identity scoring above its threshold (threshold by default), -1 if none. */
+    int recognize_face(const float *embedding, size_t size, float threshold = 0.6f) const {
+        return match_face(embedding, size, threshold).identity_id;
+    }
+
+    /**
+     * @brief Best identity if it scores above its threshold, with its margin to the runner-up
+     * identity or the threshold. threshold applies to identities without their own.
+     */
+    FaceMatch match_face(const float *embedding, size_t size, float threshold = 0.6f,
+                         GalleryTier tier = GalleryTier::kAll) const;
+
+    /**
+     * @brief The k most similar identities, best first, with names and thresholds, and the
+     * match_face() decision they lead to, so callers can weigh ambiguous faces without
+     * querying the gallery again. Only the best identity can match: a face closer to a
+     * watchlist entry than to anyone else is not handed to the runner-up.
+     * @param default_threshold  Threshold of identities without their own.
+     * @param candidates         Receives up to k candidates.
+     * @return Number of candidates.
+     */
+    size_t search_candidates(const float *embedding, size_t size, size_t k, float default_threshold,
+                             GalleryCandidate *candidates, FaceMatch &match) const;
+
+    /**
+     * @brief The k most similar identities, best first.
+     * @param hits  Receives up to k hits.
+     * @return Number of hits; 0 if the gallery (tier) is empty or the embedding size does not match.
+     */
+    size_t search(const float *embedding, size_t size, size_t k, GalleryHit *hits,
+                  GalleryTier tier = GalleryTier::kAll) const;
+
+    /** @brief search() by scanning every template, whether or not an index is enabled. */
+    size_t search_exact(const float *embedding, size_t size, size_t k, GalleryHit *hits) const;
+
+    /**
+     * @brief search() for a batch of embeddings (count rows of size floats).
+     *
+     * Scans compute the count x templates similarity matrix as one blocked matrix product:
+     * the gallery is streamed once in cache-sized tiles and every tile is scored against all
+     * queries, so a frame with many faces costs little more memory traffic than one face.
+     * Indexed searches, and int8 scans of batches too small to amortize the float matrix,
+     * run per embedding.
+     * @param hits        Receives up to k hits per embedding, embedding i at hits + i * k.
+     * @param hit_counts  Receives the number of hits of every embedding.
+     */
+    void search_batch(const float *embeddings, size_t count, size_t size, size_t k, GalleryHit *hits,
+                      size_t *hit_counts, GalleryTier tier = GalleryTier::kAll) const;
+
+    /** @brief match_face() for a batch of embeddings, through search_batch(). */
+    void match_faces(const float *embeddings, size_t count, size_t size, float threshold, FaceMatch *matches,
+                     GalleryTier tier = GalleryTier::kAll) const;
+
+    /**
+     * @brief Build an HNSW index over the templates and keep it updated on enrollment.
+     * search() uses it once the gallery holds at least min_indexed_templates templates;
+     * smaller galleries are scanned faster than the graph can be walked.
+     */
+    void enable_index(size_t m = 16, size_t ef_construction = 200, size_t ef_search = 64,
+                      size_t min_indexed_templates = 8192);
+
+    /** @brief Candidate list size of indexed searches; larger raises recall and latency. */
+    void set_index_ef_search(size_t ef_search);
+
+    const HnswIndex *index() const { return index_.get(); }
+
+    /**
+     * @brief Scan an int8 copy of the templates and re-rank the best rerank_candidates
+     * templates in float. Costs a quarter of the float matrix in extra memory; the scan
+     * streams only the int8 rows. Indexed searches are unaffected.
+     */
+    void enable_quantization(size_t rerank_candidates = 64);
+
+    bool quantized() const { return quantized_; }
+
+    /**
+     * @brief Write the gallery, with its index and int8 rows if enabled, as a gallery file.
+     * The file is written next to path and renamed over it, so processes mapping the old file
+     * keep reading it. Saving the opened gallery to its own path also empties its log.
+     */
+    bool save(const std::string& path) const;
+
+    /**
+     * @brief Replace the gallery with a gallery file and the enrollments logged since it was
+     * written, and log further enrollments. A missing file opens an empty gallery. Call it
+     * before enable_index() and enable_quantization(), which keep sections loaded from the file.
+     * @return False if the file or its log is not valid or cannot be opened.
+     */
+    bool open(const std::string& path);
+
+    /** @brief Give an identity its own match threshold, e.g. a stricter one for watchlist entries. */
+    void set_identity_threshold(int id, float threshold);
+
+    /** @brief Return an identity to the default threshold. */
+    void clear_identity_threshold(int id);
+
+    /** @brief The identity's own threshold, or default_threshold. */
+    float identity_threshold(int id, float default_threshold) const;
+
+    /** @brief Add an identity to the watchlist tier, or remove it; its templates follow. */
+    void set_watchlist(int id, bool watchlist);
+
+    bool is_watchlist(int id) const;
+    size_t num_watchlist_templates() const { return watchlist_rows_; }
+
+    // Names are stored once per identity; results only carry the ID
+    const std::string& get_identity_name(int id) const;
+
+    size_t size() const { return identities_.size(); }
+    size_t num_templates() const { return num_rows_; }
+    size_t embedding_size() const { return embedding_size_; }
+
+private:
+    void clear();
+    void insert_identity(int id, const std::string& name);
+    bool apply_threshold(int id, bool has_threshold, float threshold);
+    bool apply_watchlist(int id, bool watchlist);
+    void rebuild_watchlist();
+    void append_watchlist_row(const float *row, int id);
+    bool add_template(int id, const float *embedding, size_t size);
+    void reserve_rows(size_t rows);
+    void quantize_row(size_t row);
+    bool map_file(std::shared_ptr<const MappedFile> mapping);
+    bool replay_log(const std::string& log_path);
+    void append_log(uint32_t type, int id, const void *payload, size_t bytes);
+    size_t search_indexed(const float *embedding, size_t k, GalleryHit *hits) const;
+    void search_quantized(const float *embeddings, size_t count, size_t k, GalleryHit *hits,
+                          size_t *hit_counts) const;
+
+    // Rows of one contiguous buffer, scanned as a unit
+    struct RowSegment
+    {
+        const float *rows;
+        const int32_t *row_ids;
+        size_t count;
+    };
+    size_t row_segments(RowSegment *segments) const; // the file's rows and the enrolled ones, if any
+    size_t scan_rows(const RowSegment *segments, size_t num_segments, const float *embedding, size_t k,
+                     GalleryHit *hits) const;
+    void scan_rows_batch(const RowSegment *segments, size_t num_segments, const float *embeddings, size_t count,
+                         size_t k, GalleryHit *hits, size_t *hit_counts) const;
+
+    // Row i of the whole gallery, file rows first
+    const float *template_row(size_t i) const
+    {
+        return i < file_rows_ ? file_templates_ + i * row_stride_ : templates_.data() + (i - file_rows_) * row_stride_;
+    }
+    int32_t template_id(size_t i) const
+    {
+        return i < file_rows_ ? file_row_identity_[i] : row_identity_[i - file_rows_];
+    }
+    HnswVectors vectors() const { return HnswVectors{file_templates_, file_rows_, templates_.data(), row_stride_}; }
+
+    struct Identity
+    {
+        std::string name;
+        bool has_threshold = false;
+        float threshold = 0.0f;
+        bool watchlist = false;
+    };
+    std::unordered_map<int, Identity> identities_;
+    int next_id_;
+
+    size_t embedding_size_; // 0 until the first template
+    size_t row_stride_;     // embedding_size_ rounded up to 16 floats
+    size_t num_rows_;       // file rows, then enrolled rows
+
+    // Rows of the gallery file of open(), read in place from its mapped pages
+    std::shared_ptr<const MappedFile> mapping_; // null unless a file is mapped
+    size_t file_rows_;
+    const float *file_templates_;      // file_rows_ x row_stride_, L2-normalized
+    const int32_t *file_row_identity_; // identity ID of every file row
+
+    // Rows enrolled in memory (or replayed from the log) after the file rows
+    size_t row_capacity_;
+    AlignedBuffer<float> templates_;    // row_capacity_ x row_stride_, L2-normalized
+    std::vector<int32_t> row_identity_; // identity ID of every enrolled row
+
+    std::unique_ptr<HnswIndex> index_; // null unless enable_index()
+    size_t min_indexed_rows_;
+
+    bool quantized_;
+    size_t rerank_candidates_;
+    size_t quantized_stride_;                   // embedding_size_ rounded up to 64 bytes
+    // int8 file rows: mapped from the file, or quantized by enable_quantization() into memory
+    // the copies of the database share, as the file rows never change
+    struct QuantizedRows;
+    const int8_t *file_quantized_;
+    const float *file_quantized_scales_;
+    std::shared_ptr<const QuantizedRows> file_quantized_copy_;
+    AlignedBuffer<int8_t> quantized_templates_; // enrolled rows, row_capacity_ x quantized_stride_
+    std::vector<float> quantized_scales_;       // dequantization scale of every enrolled row
+
+    // Watchlist tier: copies of the watchlist identities' rows, same layout as templates_
+    AlignedBuffer<float> watchlist_templates_;
+    std::vector<int32_t> watchlist_row_identity_;
+    size_t watchlist_rows_;
+
+    struct LogFile;
+    std::string path_;              // gallery file of open(), empty if none
+    std::shared_ptr<LogFile> log_; // its write-ahead log, null if none
+};
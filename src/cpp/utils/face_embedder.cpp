@@ -0,0 +1,108 @@
+#include "face_embedder.h"
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+FaceEmbedder::FaceEmbedder(SessionPool &embedder_pool)
+    : embedder_pool_(embedder_pool),
+      memory_info_(Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault))
+{
+    input_shape_ = embedder_pool_.InputShapes()[0];
+    output_shape_ = embedder_pool_.OutputShapes()[0];
+    if (input_shape_.size() != 4 || output_shape_.size() != 2) {
+        throw std::invalid_argument("FaceEmbedder expects a [N, C, H, W] or [N, H, W, C] input and a [N, D] output.");
+    }
+
+    channels_last_ = (input_shape_[3] == 3);
+    if (!channels_last_ && input_shape_[1] != 3) {
+        throw std::invalid_argument("FaceEmbedder expects a 3-channel input.");
+    }
+    input_height_ = static_cast<int>(channels_last_ ? input_shape_[1] : input_shape_[2]);
+    input_width_ = static_cast<int>(channels_last_ ? input_shape_[2] : input_shape_[3]);
+    if (input_width_ <= 0 || input_height_ <= 0 || output_shape_[1] <= 0) {
+        throw std::invalid_argument("FaceEmbedder requires fixed spatial input and embedding dimensions.");
+    }
+
+    input_elements_ = static_cast<size_t>(input_width_) * input_height_ * 3;
+    embedding_size_ = output_shape_[1];
+    max_batch_size_ = (input_shape_[0] > 0) ? input_shape_[0] : 0;
+
+    aligner_ = std::make_unique<FaceAligner>(input_width_, input_height_, channels_last_);
+
+    printf("(FaceEmbedder) %s: %dx%d input, %zu-d embedding, batch %s\n",
+           embedder_pool_.ModelPath().c_str(), input_width_, input_height_, embedding_size_,
+           max_batch_size_ ? std::to_string(max_batch_size_).c_str() : "dynamic");
+}
+
+bool FaceEmbedder::Embed(const cv::Mat &rgb_image, FaceRecognitionResult &result)
+{
+    all_faces_.resize(result.num_faces);
+    for (int i = 0; i < result.num_faces; i++) {
+        all_faces_[i] = i;
+    }
+    return Embed(rgb_image, result, all_faces_.data(), all_faces_.size());
+}
+
+bool FaceEmbedder::Embed(const cv::Mat &rgb_image, FaceRecognitionResult &result, const int32_t *faces, size_t count)
+{
+    const size_t chunk = max_batch_size_ ? max_batch_size_ : count;
+
+    result.embeddings.Resize(result.num_faces * embedding_size_);
+    result.embedding_size = 0;
+
+    for (size_t start = 0; start < count; start += chunk) {
+        const size_t batch_size = std::min(chunk, count - start);
+        input_.Resize(batch_size * input_elements_);
+        output_.Resize(batch_size * embedding_size_);
+
+        keypoints_.clear();
+        for (size_t i = 0; i < batch_size; i++) {
+            const FaceKeypoint *keypoints = result.face_keypoints(faces[start + i]);
+            keypoints_.insert(keypoints_.end(), keypoints, keypoints + kNumFaceKeypoints);
+        }
+        aligner_->Run(rgb_image, keypoints_.data(), batch_size, input_.data());
+
+        if (!RunBatch(batch_size, output_.data())) {
+            return false;
+        }
+
+        for (size_t i = 0; i < batch_size; i++) {
+            const float *embedding = output_.data() + i * embedding_size_;
+            float norm = 0.0f;
+            for (size_t d = 0; d < embedding_size_; d++) {
+                norm += embedding[d] * embedding[d];
+            }
+            const float scale = (norm > 0.0f) ? 1.0f / std::sqrt(norm) : 0.0f;
+
+            float *dst = result.embeddings.data() + faces[start + i] * embedding_size_;
+            for (size_t d = 0; d < embedding_size_; d++) {
+                dst[d] = embedding[d] * scale;
+            }
+        }
+    }
+
+    result.embedding_size = embedding_size_;
+    return true;
+}
+
+bool FaceEmbedder::RunBatch(size_t batch_size, float *output)
+{
+    input_shape_[0] = output_shape_[0] = static_cast<int64_t>(batch_size);
+    Ort::Value input_value = Ort::Value::CreateTensor<float>(
+        memory_info_, input_.data(), batch_size * input_elements_, input_shape_.data(), input_shape_.size());
+    Ort::Value output_value = Ort::Value::CreateTensor<float>(
+        memory_info_, output, batch_size * embedding_size_, output_shape_.data(), output_shape_.size());
+
+    try {
+        auto session = embedder_pool_.Borrow();
+        session->Run(Ort::RunOptions{nullptr}, embedder_pool_.InputNames().data(), &input_value, 1,
+                     embedder_pool_.OutputNames().data(), &output_value, 1);
+    }
+    catch (const Ort::Exception& e) {
+        std::cerr << "ONNX Runtime embedding error: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include <onnxruntime_cxx_api.h>
+#include "face_core.h"
+#include "inference_service.h"
+#include "aligned_buffer.h"
+#include "face_align.h"
+
+/**
+ * @brief Batched face embedding stage for a FaceNet-style model.
+ *
+ * Every face of a frame is aligned to the canonical 5-point template by FaceAligner,
+ * which warps straight into its slot of one batched input tensor, and the batch is
+ * embedded with a single Run, so the cost per frame is one inference call regardless
+ * of the number of faces. Models with a fixed batch dimension are run in chunks of that size.
+ */
+class FaceEmbedder
+{
+public:
+    /** @param embedder_pool  Sessions of an embedding model with a fixed [N, 3, H, W] or [N, H, W, 3] input. */
+    explicit FaceEmbedder(SessionPool &embedder_pool);
+
+    /**
+     * @brief Align and embed all faces of one frame.
+     * @param rgb_image  Frame the face boxes and keypoints refer to, interleaved RGB.
+     * @param result     Detected faces; its embedding arena receives the L2-normalized embeddings.
+     * @return false if inference failed, in which case the result has no embeddings.
+     */
+    bool Embed(const cv::Mat &rgb_image, FaceRecognitionResult &result);
+
+    /** @brief Embed only the listed faces of the result; the arena rows of the others are left unset. */
+    bool Embed(const cv::Mat &rgb_image, FaceRecognitionResult &result, const int32_t *faces, size_t count);
+
+    size_t EmbeddingSize() const { return embedding_size_; }
+
+private:
+    bool RunBatch(size_t batch_size, float *output);
+
+    SessionPool &embedder_pool_;
+    Ort::MemoryInfo memory_info_;
+
+    int input_width_;
+    int input_height_;
+    bool channels_last_;     // NHWC input, as exported from Keras FaceNet
+    size_t max_batch_size_;  // 0 when the batch dimension is dynamic
+    size_t input_elements_;  // per-face input size
+    size_t embedding_size_;
+    std::vector<int64_t> input_shape_;
+    std::vector<int64_t> output_shape_;
+
+    std::unique_ptr<FaceAligner> aligner_;
+
+    // Batch buffers, grown to the largest crowd seen and then reused
+    AlignedBuffer<float> input_;
+    AlignedBuffer<float> output_;
+    std::vector<FaceKeypoint> keypoints_; // landmarks of the faces in the batch
+    std::vector<int32_t> all_faces_;
+};
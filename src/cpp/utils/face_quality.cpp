@@ -0,0 +1,118 @@
+#include "face_quality.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Luma samples per side of the sharpness grid, borders excluded
+constexpr int kSharpnessGrid = 24;
+
+// Margin around the landmarks covered by the sharpness grid, relative to the eye distance
+constexpr float kSharpnessMargin = 0.25f;
+
+inline float Distance(const FaceKeypoint &a, const FaceKeypoint &b)
+{
+    return std::hypot(a.x - b.x, a.y - b.y);
+}
+
+} // namespace
+
+FaceQualityScorer::FaceQualityScorer(float full_size_eye_distance, float full_sharpness_stddev)
+    : full_size_eye_distance_(full_size_eye_distance),
+      full_sharpness_variance_(full_sharpness_stddev * full_sharpness_stddev)
+{
+}
+
+FaceQuality FaceQualityScorer::Score(const cv::Mat &rgb_image, const FaceBox &face) const
+{
+    FaceQuality quality;
+    const FaceKeypoint &left_eye = face.keypoints[0], &right_eye = face.keypoints[1], &nose = face.keypoints[2];
+    const FaceKeypoint &left_mouth = face.keypoints[3], &right_mouth = face.keypoints[4];
+
+    const float eye_distance = Distance(left_eye, right_eye);
+    if (eye_distance < 1.0f) {
+        return quality;
+    }
+    quality.confidence = std::min(std::max(face.confidence, 0.0f), 1.0f);
+    quality.size = std::min(eye_distance / full_size_eye_distance_, 1.0f);
+
+    // Yaw: a turned head brings the nose closer to the eye and mouth corner of one side
+    const float left = Distance(nose, left_eye) + Distance(nose, left_mouth);
+    const float right = Distance(nose, right_eye) + Distance(nose, right_mouth);
+    const float asymmetry = std::fabs(left - right) / std::max(left + right, 1.0f);
+    const float yaw_score = std::max(1.0f - 2.0f * asymmetry, 0.0f);
+
+    // Pitch: the nose sits about halfway between the eye line and the mouth line when frontal
+    const float eye_cx = 0.5f * (left_eye.x + right_eye.x), eye_cy = 0.5f * (left_eye.y + right_eye.y);
+    const float axis_x = 0.5f * (left_mouth.x + right_mouth.x) - eye_cx;
+    const float axis_y = 0.5f * (left_mouth.y + right_mouth.y) - eye_cy;
+    const float axis_length_sq = axis_x * axis_x + axis_y * axis_y;
+    float pitch_score = 0.0f;
+    if (axis_length_sq >= 1.0f) {
+        const float along = ((nose.x - eye_cx) * axis_x + (nose.y - eye_cy) * axis_y) / axis_length_sq;
+        pitch_score = std::max(1.0f - 2.0f * std::fabs(along - 0.5f), 0.0f);
+    }
+    quality.pose = yaw_score * pitch_score;
+
+    if (quality.pose > 0.0f) {
+        quality.sharpness = SharpnessOf(rgb_image, face.keypoints, eye_distance);
+    }
+    quality.score = quality.confidence * quality.size * quality.pose * quality.sharpness;
+    return quality;
+}
+
+float FaceQualityScorer::SharpnessOf(const cv::Mat &rgb_image, const FaceKeypoint *keypoints,
+                                     float eye_distance) const
+{
+    float x_min = keypoints[0].x, x_max = keypoints[0].x, y_min = keypoints[0].y, y_max = keypoints[0].y;
+    for (size_t kp = 1; kp < kNumFaceKeypoints; kp++) {
+        x_min = std::min(x_min, keypoints[kp].x);
+        x_max = std::max(x_max, keypoints[kp].x);
+        y_min = std::min(y_min, keypoints[kp].y);
+        y_max = std::max(y_max, keypoints[kp].y);
+    }
+    const float margin = kSharpnessMargin * eye_distance;
+    const float x0 = std::max(x_min - margin, 0.0f);
+    const float y0 = std::max(y_min - margin, 0.0f);
+    const float x1 = std::min(x_max + margin, static_cast<float>(rgb_image.cols - 1));
+    const float y1 = std::min(y_max + margin, static_cast<float>(rgb_image.rows - 1));
+
+    // Samples spaced relative to the face, at least one pixel apart
+    const float step_x = std::max((x1 - x0) / (kSharpnessGrid + 1), 1.0f);
+    const float step_y = std::max((y1 - y0) / (kSharpnessGrid + 1), 1.0f);
+    const int grid_w = std::min(kSharpnessGrid, static_cast<int>((x1 - x0) / step_x) - 1);
+    const int grid_h = std::min(kSharpnessGrid, static_cast<int>((y1 - y0) / step_y) - 1);
+    if (grid_w < 1 || grid_h < 1) {
+        return 0.0f;
+    }
+
+    // Luma as (R + 2G + B) / 4, with a one-sample border for the Laplacian
+    constexpr int kStride = kSharpnessGrid + 2;
+    int luma[kStride * kStride];
+    int columns[kStride];
+    for (int gx = 0; gx < grid_w + 2; gx++) {
+        columns[gx] = static_cast<int>(x0 + gx * step_x + 0.5f) * 3;
+    }
+    for (int gy = 0; gy < grid_h + 2; gy++) {
+        const uint8_t *row = rgb_image.ptr<uint8_t>(static_cast<int>(y0 + gy * step_y + 0.5f));
+        for (int gx = 0; gx < grid_w + 2; gx++) {
+            const uint8_t *pixel = row + columns[gx];
+            luma[gy * kStride + gx] = (pixel[0] + 2 * pixel[1] + pixel[2]) >> 2;
+        }
+    }
+
+    float sum = 0.0f, sum_sq = 0.0f;
+    for (int gy = 1; gy <= grid_h; gy++) {
+        const int *center = luma + gy * kStride;
+        for (int gx = 1; gx <= grid_w; gx++) {
+            const float laplacian = static_cast<float>(4 * center[gx] - center[gx - 1] - center[gx + 1] -
+                                                       center[gx - kStride] - center[gx + kStride]);
+            sum += laplacian;
+            sum_sq += laplacian * laplacian;
+        }
+    }
+    const float count = static_cast<float>(grid_w * grid_h);
+    const float mean = sum / count;
+    const float variance = std::max(sum_sq / count - mean * mean, 0.0f);
+    return std::min(variance / full_sharpness_variance_, 1.0f);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include "face_core.h"
+
+/** @brief Quality terms of one face, each in 0..1, and their product. */
+struct FaceQuality
+{
+    float sharpness;  // variance of the Laplacian over the landmark region
+    float size;       // inter-ocular distance relative to a full-size face
+    float pose;       // frontalness from the symmetry of the 5 landmarks
+    float confidence; // detection confidence
+    float score;
+
+    FaceQuality() : sharpness(0.0f), size(0.0f), pose(0.0f), confidence(0.0f), score(0.0f) {}
+};
+
+/**
+ * @brief Fast per-face quality estimate deciding which faces are worth embedding.
+ *
+ * Uses only the frame and the detector output: the Laplacian is taken on a fixed grid of
+ * luma samples spaced relative to the face, so the cost per face is constant and blur is
+ * judged the same way for small and large faces; size and pose come from the 5 landmarks.
+ * Blurry, tiny, profile and doubtful faces score low and can be skipped before alignment.
+ */
+class FaceQualityScorer
+{
+public:
+    /**
+     * @param full_size_eye_distance  Eye distance in pixels at which a face counts as full size.
+     * @param full_sharpness_stddev   Laplacian standard deviation at which a face counts as sharp.
+     */
+    explicit FaceQualityScorer(float full_size_eye_distance = 40.0f, float full_sharpness_stddev = 12.0f);
+
+    /** @brief Score a face of the interleaved RGB frame its box and keypoints refer to. */
+    FaceQuality Score(const cv::Mat &rgb_image, const FaceBox &face) const;
+
+private:
+    float SharpnessOf(const cv::Mat &rgb_image, const FaceKeypoint *keypoints, float eye_distance) const;
+
+    float full_size_eye_distance_;
+    float full_sharpness_variance_;
+};
@@ -1,13 +1,60 @@
 #include "face_recognition.h"
 #include <algorithm>
 #include <cmath>
+#include <cstdio>
 #include <iostream>
+#include <stdexcept>
+#include "simd_scan.h"
 
-FaceRecognition::FaceRecognition(size_t input_width, size_t input_height, size_t input_channel,
-                               float confidence_thresh)
-    : ort_env_(ORT_LOGGING_LEVEL_WARNING, "FaceRecognition"),
-      ort_session_(nullptr),
-      memory_info_(Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault))
+namespace {
+
+// Number of outputs of a headless detector: bbox, confidence and keypoint maps per stride
+constexpr size_t kNumRawHeadOutputs = 9;
+
+// Channels of the raw heads: box (sigmoid center offsets, log sizes), confidence, keypoints (x, y)
+constexpr int64_t kRawBoxChannels = 4;
+constexpr int64_t kRawConfidenceChannels = 1;
+constexpr int64_t kRawKeypointChannels = kNumFaceKeypoints * 2;
+
+std::string ShapeString(const std::vector<int64_t> &shape)
+{
+    std::string text = "[";
+    for (size_t i = 0; i < shape.size(); i++) {
+        text += (i > 0 ? ", " : "") + std::to_string(shape[i]);
+    }
+    return text + "]";
+}
+
+inline float Sigmoid(float x)
+{
+    return 1.0f / (1.0f + std::exp(-x));
+}
+
+} // namespace
+
+FaceRecognition::FaceRecognition(SessionPool &detector_pool, size_t input_width, size_t input_height,
+                                 size_t input_channel, float confidence_thresh, FaceBatcher *batcher,
+                                 size_t num_slots)
+    : gallery_(std::make_shared<SharedGallery>()),
+      match_threshold_(0.6f),
+      min_quality_(0.0f),
+      detect_interval_(1),
+      cold_interval_(1),
+      frame_counter_(0),
+      heartbeat_frames_(0),
+      frames_since_detection_(0),
+      motion_pending_(false),
+      untracked_faces_(0),
+      faces_in_view_(0),
+      ungated_frames_(0),
+      gated_frames_(0),
+      detector_pool_(detector_pool),
+      batcher_(batcher),
+      memory_info_(Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeDefault)),
+      slots_(num_slots > 0 ? num_slots : 1),
+      raw_heads_(detector_pool.OutputNames().size() == kNumRawHeadOutputs),
+      raw_heads_nchw_(false),
+      nms_(kMaxNmsCandidates)
 {
     Init(input_width, input_height, input_channel, confidence_thresh);
 }
@@ -25,43 +72,35 @@ void FaceRecognition::Init(size_t accl_input_width, size_t accl_input_height, si
     accl_input_channel_ = accl_input_channel;
     confidence_thresh_ = confidence_thresh;
 
-    // Load ONNX model
-    Ort::SessionOptions session_options;
-    session_options.SetIntraOpNumThreads(4);
-    session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
-
-    try {
-        std::string model_path = "models/yolov8n-face_post.onnx";
-        ort_session_ = Ort::Session(ort_env_, model_path.c_str(), session_options);
-
-        // Get input/output names and shapes
-        size_t num_input_nodes = ort_session_.GetInputCount();
-        size_t num_output_nodes = ort_session_.GetOutputCount();
-
-        for (size_t i = 0; i < num_input_nodes; i++) {
-            auto input_name = ort_session_.GetInputNameAllocated(i, Ort::AllocatorWithDefaultOptions());
-            input_names_.push_back(input_name.get());
-            auto input_type_info = ort_session_.GetInputTypeInfo(i);
-            auto input_tensor_info = input_type_info.GetTensorTypeAndShapeInfo();
-            auto input_dims = input_tensor_info.GetShape();
-            input_shapes_.push_back(input_dims);
+    // Allocate the per-frame input and output once; every Run reuses them through IoBinding
+    input_shape_ = {1, static_cast<int64_t>(accl_input_channel_),
+                    static_cast<int64_t>(accl_input_height_), static_cast<int64_t>(accl_input_width_)};
+    const size_t num_bound_outputs = raw_heads_ ? kNumRawHeadOutputs : 1;
+    output_shapes_.assign(detector_pool_.OutputShapes().begin(), detector_pool_.OutputShapes().begin() + num_bound_outputs);
+    for (auto& shape : output_shapes_) {
+        shape[0] = 1;
+        for (size_t i = 1; i < shape.size(); i++) {
+            if (shape[i] <= 0) {
+                throw std::invalid_argument("FaceRecognition requires a detector with a fixed per-image output shape.");
+            }
         }
+    }
 
-        for (size_t i = 0; i < num_output_nodes; i++) {
-            auto output_name = ort_session_.GetOutputNameAllocated(i, Ort::AllocatorWithDefaultOptions());
-            output_names_.push_back(output_name.get());
-            auto output_type_info = ort_session_.GetOutputTypeInfo(i);
-            auto output_tensor_info = output_type_info.GetTensorTypeAndShapeInfo();
-            auto output_dims = output_tensor_info.GetShape();
-            output_shapes_.push_back(output_dims);
+    for (auto& slot : slots_) {
+        slot.input_tensor.Resize(accl_input_width_ * accl_input_height_ * accl_input_channel_);
+        slot.input_value = Ort::Value::CreateTensor<float>(memory_info_, slot.input_tensor.data(), slot.input_tensor.size(),
+                                                           input_shape_.data(), input_shape_.size());
+        slot.outputs.resize(num_bound_outputs);
+        for (size_t i = 0; i < num_bound_outputs; i++) {
+            const auto& shape = output_shapes_[i];
+            size_t elements = 1;
+            for (size_t d = 1; d < shape.size(); d++) {
+                elements *= shape[d];
+            }
+            slot.outputs[i].Resize(elements);
+            slot.output_values.push_back(Ort::Value::CreateTensor<float>(memory_info_, slot.outputs[i].data(), elements,
+                                                                         shape.data(), shape.size()));
         }
-
-        std::cout << "Loaded ONNX model: " << model_path << std::endl;
-        std::cout << "Model has " << num_input_nodes << " inputs and " << num_output_nodes << " outputs" << std::endl;
-    }
-    catch (const Ort::Exception& e) {
-        std::cerr << "Error loading ONNX model: " << e.what() << std::endl;
-        throw;
     }
 
     // Initialize layer parameters for YOLOv8n-Face (similar to YOLOv8 but with keypoints)
@@ -95,6 +134,15 @@ void FaceRecognition::Init(size_t accl_input_width, size_t accl_input_height, si
     face_detection_layers_[2].bbox_fmap_size = 20 * 20 * 4;
     face_detection_layers_[2].keypoint_fmap_size = 20 * 20 * 10;
 
+    if (raw_heads_) {
+        AssignRawHeadOutputs();
+        if (batcher_) {
+            // FaceBatcher returns only the first output
+            printf("(FaceRecognition) raw-head detector runs without cross-channel batching\n");
+            batcher_ = nullptr;
+        }
+    }
+
     // Initialize colors
     face_box_colors_ = FACE_BOX_COLORS;
     face_text_colors_ = FACE_TEXT_COLORS;
@@ -111,94 +159,403 @@ void FaceRecognition::Init(size_t accl_input_width, size_t accl_input_height, si
 void FaceRecognition::ProcessImage(uint8_t *rgb_data, int image_width, int image_height,
                                    FaceRecognitionResult &result)
 {
-    result.clear();
+    const bool detect = ShouldDetect(rgb_data, image_width, image_height);
+    if (detect) {
+        PreProcess(rgb_data, image_width, image_height, InputTensor());
+        RunDetector(result);
+    }
+    Track(result, detect);
+    Recognize(rgb_data, image_width, image_height, result);
+}
+
+void FaceRecognition::Recognize(uint8_t *rgb_data, int image_width, int image_height, FaceRecognitionResult &result)
+{
+    if (!face_embedder_) {
+        return;
+    }
+
+    // Tracked faces take the identity cached for their track, which is all propagated frames get
+    if (tracker_) {
+        recognition_cache_.NextFrame();
+        for (int i = 0; i < result.num_faces; ++i) {
+            if (result.track_id[i] >= 0) {
+                result.identity_id[i] = recognition_cache_.Identity(result.track_id[i]);
+            }
+        }
+    }
+    if (result.num_faces == 0 || !result.detected) {
+        return;
+    }
+
+    // Faces below the quality bar are never embedded; tracked ones keep their cached identity
+    cv::Mat image(image_height, image_width, CV_8UC3, rgb_data);
+    recognition_faces_.clear();
+    face_quality_.resize(result.num_faces);
+    for (int i = 0; i < result.num_faces; ++i) {
+        face_quality_[i] = quality_scorer_.Score(image, result.face(i)).score;
+        if (face_quality_[i] < min_quality_) {
+            continue;
+        }
+        if (!tracker_ || result.track_id[i] < 0 ||
+            recognition_cache_.NeedsEmbedding(result.track_id[i], face_quality_[i])) {
+            recognition_faces_.push_back(i);
+        }
+    }
+
+    if (!recognition_faces_.empty()) {
+        ProcessFaceEmbedding(image, result, recognition_faces_.data(), recognition_faces_.size());
+    }
+}
+
+void FaceRecognition::ProcessFaceEmbedding(const cv::Mat& image, FaceRecognitionResult &result,
+                                           const int32_t *faces, size_t count)
+{
+    // One inference call for all the frame's faces that need it, however many there are
+    if (!face_embedder_->Embed(image, result, faces, count)) {
+        return;
+    }
+
+    // Tracked faces are matched with the best view of their track so far. The queries are
+    // gathered so the gallery is searched once for the whole frame.
+    const size_t embedding_size = result.embedding_size;
+    match_queries_.resize(count * embedding_size);
+    for (size_t i = 0; i < count; ++i) {
+        const int face = faces[i];
+        const int track_id = tracker_ ? result.track_id[face] : -1;
+        const float *embedding = result.embedding(face);
+        if (track_id >= 0) {
+            embedding = recognition_cache_.AddEmbedding(track_id, embedding, embedding_size, face_quality_[face]);
+        }
+        std::copy(embedding, embedding + embedding_size, match_queries_.begin() + i * embedding_size);
+    }
 
-    // Create OpenCV Mat from RGB data
-    cv::Mat input_image(image_height, image_width, CV_8UC3, rgb_data);
+    matches_.resize(count);
+    SharedGallery::Snapshot gallery(*gallery_);
+    if (gallery->num_watchlist_templates() == 0) {
+        gallery->match_faces(match_queries_.data(), count, embedding_size, match_threshold_, matches_.data());
+        for (size_t i = 0; i < count; ++i) {
+            const int face = faces[i];
+            result.identity_id[face] = matches_[i].identity_id;
+            if (tracker_ && result.track_id[face] >= 0) {
+                recognition_cache_.SetMatch(result.track_id[face], matches_[i]);
+            }
+        }
+        return;
+    }
 
-    // Convert RGB to BGR for OpenCV
-    cv::Mat bgr_image;
-    cv::cvtColor(input_image, bgr_image, cv::COLOR_RGB2BGR);
+    // Watchlist first: its templates stay in cache, so alerts do not wait on the full gallery.
+    // A clear watchlist hit is final; a miss goes to the full gallery, which tracks already
+    // matched there recently skip, keeping their cached identity.
+    gallery->match_faces(match_queries_.data(), count, embedding_size, match_threshold_, matches_.data(),
+                         GalleryTier::kWatchlist);
+    full_faces_.clear();
+    for (size_t i = 0; i < count; ++i) {
+        const int face = faces[i];
+        const int track_id = tracker_ ? result.track_id[face] : -1;
+        if (matches_[i].identity_id >= 0 && matches_[i].margin >= kWatchlistConfidentMargin) {
+            result.identity_id[face] = matches_[i].identity_id;
+            if (track_id >= 0) {
+                recognition_cache_.SetMatch(track_id, matches_[i], false);
+            }
+        }
+        else if (track_id < 0 || recognition_cache_.FullSearchDue(track_id, static_cast<int>(cold_interval_))) {
+            full_faces_.push_back(i);
+        }
+    }
+    if (full_faces_.empty()) {
+        return;
+    }
 
-    // Resize with letterboxing to maintain aspect ratio
-    cv::Mat resized_image;
-    cv::resize(bgr_image, resized_image, cv::Size(letterbox_width_, letterbox_height_));
+    full_queries_.resize(full_faces_.size() * embedding_size);
+    for (size_t j = 0; j < full_faces_.size(); ++j) {
+        std::copy(match_queries_.begin() + full_faces_[j] * embedding_size,
+                  match_queries_.begin() + (full_faces_[j] + 1) * embedding_size,
+                  full_queries_.begin() + j * embedding_size);
+    }
+    full_matches_.resize(full_faces_.size());
+    gallery->match_faces(full_queries_.data(), full_faces_.size(), embedding_size, match_threshold_,
+                         full_matches_.data());
+    for (size_t j = 0; j < full_faces_.size(); ++j) {
+        const int face = faces[full_faces_[j]];
+        result.identity_id[face] = full_matches_[j].identity_id;
+        if (tracker_ && result.track_id[face] >= 0) {
+            recognition_cache_.SetMatch(result.track_id[face], full_matches_[j]);
+        }
+    }
+}
 
-    // Add padding if needed
-    cv::Mat padded_image = resized_image;
-    if (padding_height_ > 0 || padding_width_ > 0) {
-        cv::copyMakeBorder(resized_image, padded_image,
-                          padding_height_ / 2, padding_height_ - padding_height_ / 2,
-                          padding_width_ / 2, padding_width_ - padding_width_ / 2,
-                          cv::BORDER_CONSTANT, cv::Scalar(114, 114, 114));
+bool FaceRecognition::ShouldDetect(const uint8_t *rgb_data, int image_width, int image_height)
+{
+    // A frame the letterbox cannot map never reaches the detector, which would see a stale tensor
+    if (!letterbox_kernel_.IsConfigured()) {
+        ComputePadding(image_width, image_height);
+    }
+    if (!valid_input_) {
+        return false;
     }
 
-    // Normalize to [0, 1] and convert to float
-    cv::Mat normalized_image;
-    padded_image.convertTo(normalized_image, CV_32F, 1.0 / 255.0);
+    const bool due = frame_counter_++ % detect_interval_ == 0;
+    if (!motion_gate_) {
+        return due;
+    }
 
-    // Convert from HWC to CHW format for model input
-    std::vector<cv::Mat> bgr_channels;
-    cv::split(normalized_image, bgr_channels);
+    // The gate sees every frame, so motion between two detection ticks is not lost
+    if (motion_gate_->Update(rgb_data, image_width, image_height, static_cast<size_t>(image_width) * 3)) {
+        motion_pending_ = true;
+    }
+    frames_since_detection_++;
+    if (!due) {
+        return false;
+    }
 
-    // Prepare input tensor
-    size_t input_tensor_size = accl_input_width_ * accl_input_height_ * 3;
-    std::vector<float> input_tensor_values(input_tensor_size);
+    if (motion_pending_ || faces_in_view_ > 0 || frames_since_detection_ >= heartbeat_frames_) {
+        motion_pending_ = false;
+        frames_since_detection_ = 0;
+        ungated_frames_++;
+        return true;
+    }
+    gated_frames_++;
+    return false;
+}
 
-    // Copy BGR channels in CHW format
-    int img_size = accl_input_width_ * accl_input_height_;
-    for (int c = 0; c < 3; ++c) {
-        std::memcpy(input_tensor_values.data() + c * img_size, bgr_channels[c].data, img_size * sizeof(float));
+void FaceRecognition::Track(FaceRecognitionResult &result, bool detected)
+{
+    if (!tracker_) {
+        // Without tracks to propagate, a skipped frame has no faces
+        if (!detected) {
+            result.clear();
+            result.detected = false;
+        }
+        faces_in_view_ = result.num_faces;
+        return;
+    }
+    if (detected) {
+        // Every face the detector reports may start a track, or it would vanish between detections
+        tracker_->SetHighScore(GetConfidenceThreshold());
+        tracker_->Update(result);
+        untracked_faces_ = static_cast<int>(std::count(result.track_id.begin(), result.track_id.end(), -1));
+    }
+    else {
+        tracker_->Predict(result);
     }
+    // A face too weak to start a track is still in view: it must not fade into the background
+    faces_in_view_ = static_cast<int>(tracker_->NumTracks()) + untracked_faces_;
+}
+
+void FaceRecognition::RunDetector(FaceRecognitionResult &result)
+{
+    Infer(0);
+    PostProcess(0, result);
+}
 
-    // Create input tensor
-    std::vector<Ort::Value> input_tensors;
-    input_tensors.push_back(Ort::Value::CreateTensor<float>(
-        memory_info_, input_tensor_values.data(), input_tensor_size,
-        input_shapes_[0].data(), input_shapes_[0].size()));
+bool FaceRecognition::Infer(size_t slot_idx)
+{
+    FrameSlot &slot = slots_[slot_idx];
+    slot.output_valid = false;
 
-    // Run inference
-    try {
-        auto output_tensors = ort_session_.Run(Ort::RunOptions{nullptr},
-                                              input_names_.data(), input_tensors.data(), 1,
-                                              output_names_.data(), output_names_.size());
+    if (batcher_) {
+        // Detections come back once this frame's batch has run
+        slot.output_valid = batcher_->Infer(slot.input_tensor.data(), slot.outputs[0].data());
+        return slot.output_valid;
+    }
 
-        // Process outputs for face detection
-        ProcessDetectionOutput(output_tensors, result);
+    // Run inference on whichever shared session is idle, straight into the bound buffers
+    try {
+        auto session = detector_pool_.Borrow();
+        session->Run(Ort::RunOptions{nullptr}, GetBinding(*session, slot));
     }
     catch (const Ort::Exception& e) {
         std::cerr << "ONNX Runtime inference error: " << e.what() << std::endl;
+        return false;
+    }
+
+    slot.output_valid = true;
+    return true;
+}
+
+void FaceRecognition::PostProcess(size_t slot_idx, FaceRecognitionResult &result)
+{
+    result.clear();
+
+    // Process outputs for face detection
+    const FrameSlot &slot = slots_[slot_idx];
+    if (!slot.output_valid) {
+        return;
+    }
+    if (raw_heads_) {
+        ProcessRawHeadOutput(slot, result);
+    }
+    else {
+        ProcessDetectionOutput(slot.outputs[0].data(), output_shapes_[0], result);
+    }
+}
+
+void FaceRecognition::AssignRawHeadOutputs()
+{
+    const uint8_t kUnassigned = 0xFF;
+    for (auto& layer : face_detection_layers_) {
+        layer.bbox_ofmap_flow_id = layer.confidence_ofmap_flow_id = layer.keypoint_ofmap_flow_id = kUnassigned;
+    }
+
+    // Each head is NHWC [1, H, W, C] or NCHW [1, C, H, W], all in the same layout, with C = 4 (box),
+    // 1 (confidence) or 10 (keypoints); the grid size picks the layer
+    int nchw = -1; // layout of the heads so far, unknown until the first one
+    for (size_t i = 0; i < output_shapes_.size(); i++) {
+        const auto& shape = output_shapes_[i];
+        const std::string head = std::string("Raw-head detector output ") + detector_pool_.OutputNames()[i] +
+                                 " " + ShapeString(shape);
+        if (shape.size() != 4 || shape[0] > 1) {
+            throw std::invalid_argument(head + " is not a [1, H, W, C] or [1, C, H, W] map.");
+        }
+
+        bool assigned = false;
+        for (auto& layer : face_detection_layers_) {
+            const int64_t height = static_cast<int64_t>(layer.height);
+            const int64_t width = static_cast<int64_t>(layer.width);
+            const bool is_nhwc = shape[1] == height && shape[2] == width;
+            const bool is_nchw = shape[2] == height && shape[3] == width;
+            if (!is_nhwc && !is_nchw) {
+                continue;
+            }
+            if (nchw >= 0 && nchw != (is_nchw ? 1 : 0)) {
+                throw std::invalid_argument(head + " does not share the layout of the other heads.");
+            }
+            nchw = is_nchw ? 1 : 0;
+
+            const int64_t channels = is_nchw ? shape[1] : shape[3];
+            uint8_t *flow_id = channels == kRawBoxChannels          ? &layer.bbox_ofmap_flow_id
+                               : channels == kRawConfidenceChannels ? &layer.confidence_ofmap_flow_id
+                               : channels == kRawKeypointChannels   ? &layer.keypoint_ofmap_flow_id
+                                                                    : nullptr;
+            if (!flow_id) {
+                // A DFL box head (4 x reg_max channels) has to be exported with its distribution decoded
+                throw std::invalid_argument(head + " has " + std::to_string(channels) +
+                                            " channels, expected 4 (box), 1 (confidence) or 10 (keypoints).");
+            }
+            if (*flow_id != kUnassigned) {
+                throw std::invalid_argument(head + " duplicates another head of its grid.");
+            }
+            *flow_id = static_cast<uint8_t>(i);
+            assigned = true;
+            break;
+        }
+        if (!assigned) {
+            throw std::invalid_argument(head + " is not on the 80x80, 40x40 or 20x20 grid.");
+        }
+    }
+    raw_heads_nchw_ = nchw == 1;
+
+    size_t max_cells = 0;
+    for (const auto& layer : face_detection_layers_) {
+        if (layer.bbox_ofmap_flow_id == kUnassigned || layer.confidence_ofmap_flow_id == kUnassigned ||
+            layer.keypoint_ofmap_flow_id == kUnassigned) {
+            throw std::invalid_argument("Raw-head detector must output box, confidence and keypoint maps for the 80x80, 40x40 and 20x20 grids.");
+        }
+        max_cells = std::max(max_cells, layer.width * layer.height);
+    }
+
+    candidate_cells_.Resize(max_cells);
+    decode_scratch_.Resize(max_cells * 15);
+}
+
+void FaceRecognition::ProcessRawHeadOutput(const FrameSlot &slot, FaceRecognitionResult &result)
+{
+    // Sigmoid is monotonic, so compare raw logits against the threshold's logit and
+    // only pay for the transcendental math on the cells that pass
+    const float confidence_thresh = std::min(std::max(GetConfidenceThreshold(), 1e-6f), 1.0f - 1e-6f);
+    const float logit_thresh = std::log(confidence_thresh / (1.0f - confidence_thresh));
+
+    decoded_faces_.clear();
+    for (size_t layer_id = 0; layer_id < kNumPostProcessLayers; layer_id++) {
+        const auto& layer = face_detection_layers_[layer_id];
+        const float *confidence_buffer = slot.outputs[layer.confidence_ofmap_flow_id].data();
+
+        size_t num_cells = ScanThreshold(confidence_buffer, layer.width * layer.height, logit_thresh,
+                                      candidate_cells_.data());
+        if (num_cells > 0) {
+            GetFaceDetection(decoded_faces_, layer_id, confidence_buffer,
+                             slot.outputs[layer.bbox_ofmap_flow_id].data(),
+                             slot.outputs[layer.keypoint_ofmap_flow_id].data(),
+                             candidate_cells_.data(), num_cells);
+        }
+    }
+
+    ApplyNMS(decoded_faces_);
+    for (const auto& face : decoded_faces_) {
+        result.add_face(face);
+    }
+    ScaleToDisplay(result);
+}
+
+Ort::IoBinding &FaceRecognition::GetBinding(Ort::Session &session, FrameSlot &slot)
+{
+    for (auto& entry : slot.bindings) {
+        if (entry.first == &session) {
+            return entry.second;
+        }
+    }
+
+    // At most one binding per pooled session, so this only runs during warm-up
+    Ort::IoBinding binding(session);
+    binding.BindInput(detector_pool_.InputNames()[0], slot.input_value);
+    for (size_t i = 0; i < slot.output_values.size(); i++) {
+        binding.BindOutput(detector_pool_.OutputNames()[i], slot.output_values[i]);
     }
+    for (size_t i = slot.output_values.size(); i < detector_pool_.OutputNames().size(); i++) {
+        binding.BindOutput(detector_pool_.OutputNames()[i], memory_info_);
+    }
+    slot.bindings.emplace_back(&session, std::move(binding));
+    return slot.bindings.back().second;
+}
+
+void FaceRecognition::PreProcess(uint8_t *rgb_data, int image_width, int image_height, float *input_tensor)
+{
+    if (!letterbox_kernel_.IsConfigured()) {
+        ComputePadding(image_width, image_height);
+    }
+
+    // Letterbox, RGB->BGR, normalize and HWC->CHW in a single pass over the frame
+    letterbox_kernel_.Run(rgb_data, input_tensor);
 }
 
-void FaceRecognition::ProcessDetectionOutput(std::vector<Ort::Value>& output_tensors, FaceRecognitionResult &result)
+void FaceRecognition::ProcessDetectionOutput(const float *output_data, const std::vector<int64_t> &output_shape,
+                                             FaceRecognitionResult &result)
 {
     result.clear();
-    std::vector<FaceBox> faces_vector;
 
     // Process the ONNX model output
     // Assuming YOLOv8n-face output format: [batch, 5 + num_keypoints*2 + num_classes, num_detections]
-    if (output_tensors.empty()) {
+    if (output_shape.size() < 3) {
         return;
     }
 
-    float* output_data = output_tensors[0].GetTensorMutableData<float>();
-    auto output_shape = output_tensors[0].GetTensorTypeAndShapeInfo().GetShape();
-
     // YOLOv8 output format: [batch, 4+1+10, 8400] where:
     // 4: bbox coords (cx, cy, w, h)
     // 1: confidence
     // 10: 5 keypoints (x, y for each)
     int num_detections = output_shape[2];
-    int num_features = output_shape[1];  // Should be 15 (4+1+10)
+    const float confidence_thresh = GetConfidenceThreshold();
 
-    for (int i = 0; i < num_detections; ++i) {
-        // Extract confidence
-        float confidence = output_data[4 * num_detections + i];
+    // The confidence row is contiguous, so one SIMD pass finds the few anchors worth decoding
+    candidate_cells_.Resize(num_detections);
+    size_t num_candidates = ScanThreshold(output_data + 4 * num_detections, num_detections, confidence_thresh,
+                                          candidate_cells_.data());
 
-        if (confidence < confidence_thresh_) {
-            continue;
-        }
+    // Suppress on the raw boxes, so FaceBoxes are only built for the survivors
+    nms_.Reset();
+    for (size_t c = 0; c < num_candidates; ++c) {
+        const int i = candidate_cells_[c];
+        float cx = output_data[0 * num_detections + i];
+        float cy = output_data[1 * num_detections + i];
+        float half_w = output_data[2 * num_detections + i] / 2.0f;
+        float half_h = output_data[3 * num_detections + i] / 2.0f;
+        nms_.Add(cx - half_w, cy - half_h, cx + half_w, cy + half_h, output_data[4 * num_detections + i]);
+    }
+    size_t num_kept = nms_.Run(kNmsIouThreshold);
+
+    for (size_t k = 0; k < num_kept; ++k) {
+        const int i = candidate_cells_[nms_.Kept()[k]];
+        float confidence = output_data[4 * num_detections + i];
 
         // Extract bbox coordinates (center format)
         float cx = output_data[0 * num_detections + i];
@@ -215,154 +572,164 @@ void FaceRecognition::ProcessDetectionOutput(std::vector<Ort::Value>& output_ten
         face_box.y_max = cy + h / 2.0f;
 
         // Extract keypoints (5 points, 2 coords each)
-        for (int kp = 0; kp < 5; ++kp) {
+        for (size_t kp = 0; kp < kNumFaceKeypoints; ++kp) {
             float kp_x = output_data[(5 + kp * 2) * num_detections + i];
             float kp_y = output_data[(5 + kp * 2 + 1) * num_detections + i];
             face_box.keypoints[kp] = FaceKeypoint(kp_x, kp_y, 1.0f);
         }
 
-        faces_vector.push_back(face_box);
+        // Identities are assigned by the embedding stage, if enabled
+        result.add_face(face_box);
     }
 
-    // Apply Non-Maximum Suppression
-    ApplyNMS(faces_vector);
-
-    // Process face recognition for each detected face
-    for (auto& face : faces_vector) {
-        // For now, assign unknown identity
-        // In a full implementation, you would extract the face region,
-        // run it through the FaceNet model, and match against the database
-        face.identity_id = -1;
-        face.identity_name = "Unknown";
+    ScaleToDisplay(result);
+}
 
-        result.add_face(face);
+void FaceRecognition::ScaleToDisplay(FaceRecognitionResult &result)
+{
+    const float pad_left = padding_width_ / 2;
+    const float pad_top = padding_height_ / 2;
+    const float inv_ratio = 1.0f / letterbox_ratio_;
+
+    for (int i = 0; i < result.num_faces; ++i) {
+        result.x_min[i] = (result.x_min[i] - pad_left) * inv_ratio;
+        result.y_min[i] = (result.y_min[i] - pad_top) * inv_ratio;
+        result.x_max[i] = (result.x_max[i] - pad_left) * inv_ratio;
+        result.y_max[i] = (result.y_max[i] - pad_top) * inv_ratio;
+    }
+    for (auto& keypoint : result.keypoints) {
+        keypoint.x = (keypoint.x - pad_left) * inv_ratio;
+        keypoint.y = (keypoint.y - pad_top) * inv_ratio;
     }
 }
 
-void FaceRecognition::GetFaceDetection(std::queue<FaceBox> &face_boxes, int layer_id,
-                                      float *confidence_buffer, float *bbox_buffer,
-                                      float *keypoint_buffer, int row, int col)
+void FaceRecognition::GetFaceDetection(std::vector<FaceBox> &faces, int layer_id,
+                                      const float *confidence_buffer, const float *bbox_buffer,
+                                      const float *keypoint_buffer, const int32_t *cells, size_t num_cells)
 {
     const auto& layer = face_detection_layers_[layer_id];
-    int grid_idx = row * layer.width + col;
-
-    // Get confidence score
-    float confidence = mxutil_prepost_sigmoid(confidence_buffer[grid_idx]);
-
-    if (confidence < confidence_thresh_) {
-        return;
+    const size_t grid_cells = layer.width * layer.height;
+
+    // Scratch laid out as confidence, box (4) and keypoint (10) rows of num_cells each
+    float *confidence = decode_scratch_.data();
+    float *center_x = confidence + num_cells;
+    float *center_y = center_x + num_cells;
+    float *box_width = center_y + num_cells;
+    float *box_height = box_width + num_cells;
+    float *keypoints = box_height + num_cells;
+
+    // Gather the candidates, then run the sigmoids as flat loops the compiler vectorizes
+    for (size_t i = 0; i < num_cells; i++) {
+        confidence[i] = confidence_buffer[cells[i]];
+        for (int k = 0; k < kRawKeypointChannels; k++) {
+            keypoints[k * num_cells + i] =
+                keypoint_buffer[RawHeadOffset(cells[i], k, kRawKeypointChannels, grid_cells)];
+        }
+    }
+    for (size_t i = 0; i < num_cells; i++) {
+        confidence[i] = Sigmoid(confidence[i]);
+    }
+    for (size_t i = 0; i < num_cells * 10; i++) {
+        keypoints[i] = Sigmoid(keypoints[i]);
     }
 
-    // Create face box
-    FaceBox face_box;
-    face_box.confidence = confidence;
+    CalculateFaceParams(bbox_buffer, layer_id, cells, num_cells, center_x, center_y, box_width, box_height);
 
-    // Calculate bounding box coordinates
-    float center_x, center_y, box_width, box_height;
-    CalculateFaceParams(&bbox_buffer[grid_idx * 4], layer_id, row, col,
-                       center_x, center_y, box_width, box_height);
+    for (size_t i = 0; i < num_cells; i++) {
+        const int row = cells[i] / layer.width;
+        const int col = cells[i] % layer.width;
 
-    // Convert to corner coordinates
-    face_box.x_min = center_x - box_width / 2.0f;
-    face_box.y_min = center_y - box_height / 2.0f;
-    face_box.x_max = center_x + box_width / 2.0f;
-    face_box.y_max = center_y + box_height / 2.0f;
+        // Convert to corner coordinates
+        FaceBox face_box;
+        face_box.confidence = confidence[i];
+        face_box.x_min = center_x[i] - box_width[i] / 2.0f;
+        face_box.y_min = center_y[i] - box_height[i] / 2.0f;
+        face_box.x_max = center_x[i] + box_width[i] / 2.0f;
+        face_box.y_max = center_y[i] + box_height[i] / 2.0f;
+
+        // Process keypoints (5 facial landmarks)
+        for (size_t kp = 0; kp < kNumFaceKeypoints; ++kp) {
+            float kp_x = (col + keypoints[(kp * 2) * num_cells + i]) * layer.ratio;
+            float kp_y = (row + keypoints[(kp * 2 + 1) * num_cells + i]) * layer.ratio;
+            face_box.keypoints[kp] = FaceKeypoint(kp_x, kp_y, 1.0f);
+        }
 
-    // Process keypoints (5 facial landmarks)
-    for (int kp = 0; kp < 5; ++kp) {
-        int kp_idx = grid_idx * 10 + kp * 2;
-        float kp_x = (col + mxutil_prepost_sigmoid(keypoint_buffer[kp_idx])) * layer.ratio;
-        float kp_y = (row + mxutil_prepost_sigmoid(keypoint_buffer[kp_idx + 1])) * layer.ratio;
-        face_box.keypoints[kp] = FaceKeypoint(kp_x, kp_y, 1.0f);
+        faces.push_back(face_box);
     }
-
-    face_boxes.push(face_box);
 }
 
-void FaceRecognition::CalculateFaceParams(const float *feature_values, int layer_id, int row, int col,
-                                         float &center_x, float &center_y, float &box_width, float &box_height)
+void FaceRecognition::CalculateFaceParams(const float *bbox_buffer, int layer_id, const int32_t *cells, size_t num_cells,
+                                         float *center_x, float *center_y, float *box_width, float *box_height)
 {
     const auto& layer = face_detection_layers_[layer_id];
+    const float ratio = static_cast<float>(layer.ratio);
+
+    const size_t grid_cells = layer.width * layer.height;
+    for (size_t i = 0; i < num_cells; i++) {
+        center_x[i] = bbox_buffer[RawHeadOffset(cells[i], 0, kRawBoxChannels, grid_cells)];
+        center_y[i] = bbox_buffer[RawHeadOffset(cells[i], 1, kRawBoxChannels, grid_cells)];
+        box_width[i] = bbox_buffer[RawHeadOffset(cells[i], 2, kRawBoxChannels, grid_cells)];
+        box_height[i] = bbox_buffer[RawHeadOffset(cells[i], 3, kRawBoxChannels, grid_cells)];
+    }
 
     // YOLOv8 bbox format: center_x, center_y, width, height
-    center_x = (col + mxutil_prepost_sigmoid(feature_values[0])) * layer.ratio;
-    center_y = (row + mxutil_prepost_sigmoid(feature_values[1])) * layer.ratio;
-    box_width = exp(feature_values[2]) * layer.ratio;
-    box_height = exp(feature_values[3]) * layer.ratio;
-}
-
-void FaceRecognition::ApplyNMS(std::vector<FaceBox>& faces, float iou_threshold)
-{
-    // Sort by confidence score (descending)
-    std::sort(faces.begin(), faces.end(),
-              [](const FaceBox& a, const FaceBox& b) {
-                  return a.confidence > b.confidence;
-              });
-
-    std::vector<bool> suppressed(faces.size(), false);
-
-    for (size_t i = 0; i < faces.size(); ++i) {
-        if (suppressed[i]) continue;
-
-        for (size_t j = i + 1; j < faces.size(); ++j) {
-            if (suppressed[j]) continue;
-
-            float iou = CalculateIoU(faces[i], faces[j]);
-            if (iou > iou_threshold) {
-                suppressed[j] = true;
-            }
-        }
+    for (size_t i = 0; i < num_cells; i++) {
+        center_x[i] = Sigmoid(center_x[i]);
+        center_y[i] = Sigmoid(center_y[i]);
+        box_width[i] = std::exp(box_width[i]) * ratio;
+        box_height[i] = std::exp(box_height[i]) * ratio;
     }
 
-    // Remove suppressed faces
-    auto it = std::remove_if(faces.begin(), faces.end(),
-                            [&](const FaceBox& face) {
-                                size_t idx = &face - &faces[0];
-                                return suppressed[idx];
-                            });
-    faces.erase(it, faces.end());
+    for (size_t i = 0; i < num_cells; i++) {
+        center_x[i] = (cells[i] % layer.width + center_x[i]) * ratio;
+        center_y[i] = (cells[i] / layer.width + center_y[i]) * ratio;
+    }
 }
 
-float FaceRecognition::CalculateIoU(const FaceBox& box1, const FaceBox& box2)
+void FaceRecognition::ApplyNMS(std::vector<FaceBox>& faces, float iou_threshold)
 {
-    float x1 = mxutil_max(box1.x_min, box2.x_min);
-    float y1 = mxutil_max(box1.y_min, box2.y_min);
-    float x2 = mxutil_min(box1.x_max, box2.x_max);
-    float y2 = mxutil_min(box1.y_max, box2.y_max);
-
-    if (x2 <= x1 || y2 <= y1) return 0.0f;
-
-    float intersection = (x2 - x1) * (y2 - y1);
-    float area1 = (box1.x_max - box1.x_min) * (box1.y_max - box1.y_min);
-    float area2 = (box2.x_max - box2.x_min) * (box2.y_max - box2.y_min);
-    float union_area = area1 + area2 - intersection;
+    nms_.Reset();
+    for (const auto& face : faces) {
+        nms_.Add(face.x_min, face.y_min, face.x_max, face.y_max, face.confidence);
+    }
+    size_t num_kept = nms_.Run(iou_threshold);
 
-    return union_area > 0 ? intersection / union_area : 0.0f;
+    // Survivors in descending confidence; the scratch vector keeps its capacity for the next frame
+    nms_faces_.clear();
+    for (size_t k = 0; k < num_kept; ++k) {
+        nms_faces_.push_back(std::move(faces[nms_.Kept()[k]]));
+    }
+    faces.swap(nms_faces_);
 }
 
 void FaceRecognition::DrawResult(FaceRecognitionResult &result, cv::Mat &image)
 {
-    for (const auto& face : result.faces) {
+    SharedGallery::Snapshot gallery(*gallery_);
+    for (int i = 0; i < result.num_faces; ++i) {
         // Choose color based on identity
-        int color_idx = (face.identity_id >= 0) ? (face.identity_id % face_box_colors_.size()) : 0;
+        const int identity_id = result.identity_id[i];
+        int color_idx = (identity_id >= 0) ? (identity_id % face_box_colors_.size()) : 0;
         cv::Scalar box_color = face_box_colors_[color_idx];
         cv::Scalar text_color = face_text_colors_[color_idx];
 
         // Draw bounding box
-        cv::Point top_left(static_cast<int>(face.x_min), static_cast<int>(face.y_min));
-        cv::Point bottom_right(static_cast<int>(face.x_max), static_cast<int>(face.y_max));
+        cv::Point top_left(static_cast<int>(result.x_min[i]), static_cast<int>(result.y_min[i]));
+        cv::Point bottom_right(static_cast<int>(result.x_max[i]), static_cast<int>(result.y_max[i]));
         cv::rectangle(image, top_left, bottom_right, box_color, 2);
 
         // Draw keypoints
-        for (const auto& keypoint : face.keypoints) {
-            if (keypoint.confidence > 0.5f) {
-                cv::circle(image, cv::Point(static_cast<int>(keypoint.x), static_cast<int>(keypoint.y)),
+        const FaceKeypoint *keypoints = result.face_keypoints(i);
+        for (size_t kp = 0; kp < kNumFaceKeypoints; ++kp) {
+            if (keypoints[kp].confidence > 0.5f) {
+                cv::circle(image, cv::Point(static_cast<int>(keypoints[kp].x), static_cast<int>(keypoints[kp].y)),
                           3, box_color, -1);
             }
         }
 
         // Draw identity label
-        std::string label = face.identity_name + " (" + std::to_string(static_cast<int>(face.confidence * 100)) + "%)";
+        char label[96];
+        snprintf(label, sizeof(label), "%s (%d%%)", gallery->get_identity_name(identity_id).c_str(),
+                 static_cast<int>(result.confidence[i] * 100));
 
         int baseline = 0;
         cv::Size text_size = cv::getTextSize(label, cv::FONT_HERSHEY_SIMPLEX, 0.5, 1, &baseline);
@@ -396,14 +763,14 @@ float FaceRecognition::GetConfidenceThreshold()
 
 void FaceRecognition::ComputePadding(int disp_width, int disp_height)
 {
-    if (!IsHorizontalInput(disp_width, disp_height)) {
+    if (disp_width <= 0 || disp_height <= 0) {
         valid_input_ = false;
         return;
     }
 
     valid_input_ = true;
 
-    // Calculate letterbox parameters
+    // Landscape frames are padded above and below, portrait ones left and right
     float scale = std::min(static_cast<float>(accl_input_width_) / disp_width,
                           static_cast<float>(accl_input_height_) / disp_height);
 
@@ -414,6 +781,9 @@ void FaceRecognition::ComputePadding(int disp_width, int disp_height)
     padding_height_ = accl_input_height_ - letterbox_height_;
 
     letterbox_ratio_ = scale;
+
+    letterbox_kernel_.Configure(disp_width, disp_height, accl_input_width_, accl_input_height_,
+                                letterbox_width_, letterbox_height_, padding_width_ / 2, padding_height_ / 2);
 }
 
 bool FaceRecognition::IsHorizontalInput(int disp_width, int disp_height)
@@ -421,12 +791,47 @@ bool FaceRecognition::IsHorizontalInput(int disp_width, int disp_height)
     return disp_width >= disp_height;
 }
 
+void FaceRecognition::EnableRecognition(SessionPool &embedder_pool, float match_threshold, float min_quality)
+{
+    face_embedder_ = std::make_unique<FaceEmbedder>(embedder_pool);
+    match_threshold_ = match_threshold;
+    min_quality_ = min_quality;
+}
+
+void FaceRecognition::EnableTracking(size_t detect_interval, size_t cold_interval)
+{
+    tracker_ = std::make_unique<FaceTracker>(GetConfidenceThreshold());
+    detect_interval_ = detect_interval > 0 ? detect_interval : 1;
+    cold_interval_ = cold_interval > 0 ? cold_interval : 1;
+}
+
+void FaceRecognition::EnableMotionGate(size_t heartbeat_frames, int pixel_threshold)
+{
+    motion_gate_ = std::make_unique<MotionGate>(kMotionGateWidth, kMotionGateHeight, pixel_threshold);
+    heartbeat_frames_ = heartbeat_frames > 0 ? heartbeat_frames : 1;
+}
+
+void FaceRecognition::UseGallery(std::shared_ptr<SharedGallery> gallery)
+{
+    gallery_ = std::move(gallery);
+}
+
 int FaceRecognition::AddIdentity(const std::string& name)
 {
-    return face_database_.add_identity(name);
+    return gallery_->AddIdentity(name);
 }
 
 void FaceRecognition::AddEmbeddingToIdentity(int id, const std::vector<float>& embedding)
 {
-    face_database_.add_embedding_to_identity(id, embedding);
+    gallery_->AddEmbeddingToIdentity(id, embedding);
+}
+
+void FaceRecognition::SetIdentityThreshold(int id, float threshold)
+{
+    gallery_->SetIdentityThreshold(id, threshold);
+}
+
+void FaceRecognition::SetWatchlist(int id, bool watchlist)
+{
+    gallery_->SetWatchlist(id, watchlist);
 }
\ No newline at end of file
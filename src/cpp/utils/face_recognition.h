@@ -6,14 +6,31 @@
 #include <opencv2/imgproc.hpp>
 #include <opencv2/imgcodecs.hpp>
 #include <mutex>
+#include <memory>
+#include <atomic>
 #include <onnxruntime_cxx_api.h>
+#include "inference_service.h"
+#include "face_batcher.h"
+#include "face_embedder.h"
+#include "aligned_buffer.h"
+#include "letterbox_kernel.h"
+#include "nms.h"
+#include "face_tracker.h"
+#include "recognition_cache.h"
+#include "motion_gate.h"
+#include "face_quality.h"
+#include "shared_gallery.h"
 
 class FaceRecognition
 {
 public:
-    /** @brief Constructor for face recognition system. */
-    FaceRecognition(size_t input_width, size_t input_height, size_t input_channel,
-                   float confidence_thresh);
+    /**
+     * @brief Constructor for face recognition system, running the detector on a shared session pool.
+     * @param batcher    Optional cross-channel batcher; when null every frame runs as a batch of 1.
+     * @param num_slots  Number of frames that can be in flight at once, one input/output pair each.
+     */
+    FaceRecognition(SessionPool &detector_pool, size_t input_width, size_t input_height, size_t input_channel,
+                   float confidence_thresh, FaceBatcher *batcher = nullptr, size_t num_slots = 1);
 
     ~FaceRecognition();
 
@@ -23,9 +40,54 @@ public:
      * @param image_width   Width of the display image.
      * @param image_height  Height of the display image.
      * @param result        Reference to the structure where the face recognition results will be stored.
+     *                      Reuse it across frames; its columns then stop allocating once warmed up.
      */
     void ProcessImage(uint8_t *rgb_data, int image_width, int image_height, FaceRecognitionResult &result);
 
+    /**
+     * @brief Letterbox, normalize and convert the input image into the detector's CHW input tensor.
+     * @param input_tensor  Destination buffer of input_width * input_height * 3 floats.
+     */
+    void PreProcess(uint8_t *rgb_data, int image_width, int image_height, float *input_tensor);
+
+    /** @brief Run the detector on the tensor currently in InputTensor() and decode its output. */
+    void RunDetector(FaceRecognitionResult &result);
+
+    /**
+     * @brief Pipelined stages of RunDetector for one slot. PreProcess into InputTensor(slot),
+     * Infer(slot) and PostProcess(slot) may run on different threads for different slots.
+     * @return Infer returns false if the detector failed; the slot then decodes to no faces.
+     */
+    bool Infer(size_t slot);
+    void PostProcess(size_t slot, FaceRecognitionResult &result);
+
+    /**
+     * @brief Embed and identify the detected faces of the frame, if recognition is enabled.
+     * Faces under the quality bar are skipped. With tracking, faces take their track's cached
+     * identity and are only embedded, on detected frames, when their track is new, the view is
+     * clearly better or the match is ambiguous.
+     */
+    void Recognize(uint8_t *rgb_data, int image_width, int image_height, FaceRecognitionResult &result);
+
+    /**
+     * @brief Whether the next frame goes through the detector; call once per frame, in capture order.
+     * Always true unless tracking or the motion gate is enabled. With the gate, a frame due for
+     * detection is skipped while nothing moved since the last detection, no face is in view and
+     * the heartbeat has not expired.
+     */
+    bool ShouldDetect(const uint8_t *rgb_data, int image_width, int image_height);
+
+    /**
+     * @brief Tracking stage, in frame order. Assigns track IDs to a detected frame's faces,
+     * or fills result with the propagated tracks when the frame skipped the detector.
+     */
+    void Track(FaceRecognitionResult &result, bool detected);
+
+    /** @brief A slot's bound detector input, input_width * input_height * 3 floats. */
+    float *InputTensor(size_t slot = 0) { return slots_[slot].input_tensor.data(); }
+
+    size_t NumSlots() const { return slots_.size(); }
+
     /** @brief Draw detected faces and identities on the provided image. */
     void DrawResult(FaceRecognitionResult &result, cv::Mat &image);
 
@@ -36,19 +98,69 @@ public:
     void SetConfidenceThreshold(float confidence);
     float GetConfidenceThreshold();
 
-    /** @brief Compute padding values for letterboxing from the display image. */
+    /** @brief Compute padding values for letterboxing from the display image, of any aspect ratio. */
     void ComputePadding(int disp_width, int disp_height);
 
     /** @brief Ensure the input dimensions are valid for horizontal display images only. */
     bool IsHorizontalInput(int disp_width, int disp_height);
 
+    /**
+     * @brief Embed the detected faces of every frame and match them against the face database.
+     * @param embedder_pool    Sessions of the embedding model, shared with the other channels.
+     * @param match_threshold  Minimum cosine similarity for a face to take an identity.
+     * @param min_quality      Faces scoring lower (blurry, tiny, profile) are not embedded.
+     */
+    void EnableRecognition(SessionPool &embedder_pool, float match_threshold, float min_quality = 0.0f);
+
+    /**
+     * @brief Match against a face database shared with other channels instead of a private one.
+     * Searches read its current snapshot without locking; enrollments publish to every channel.
+     */
+    void UseGallery(std::shared_ptr<SharedGallery> gallery);
+
+    /**
+     * @brief Track faces across frames and run the detector only on every detect_interval-th frame.
+     * The tracker propagates the boxes in between, and identities are cached per track.
+     * @param cold_interval  With a watchlist, a track missing it is searched in the full gallery
+     *                       at most once every cold_interval frames.
+     */
+    void EnableTracking(size_t detect_interval, size_t cold_interval = 15);
+
+    /**
+     * @brief Skip the detector on static scenes.
+     * @param heartbeat_frames  The detector still runs at least once every heartbeat_frames frames.
+     * @param pixel_threshold   Min luma change of a thumbnail pixel to count as motion.
+     */
+    void EnableMotionGate(size_t heartbeat_frames, int pixel_threshold);
+
+    /** @brief Frames the detector ran on, and frames the motion gate skipped; safe from any thread. */
+    uint64_t UngatedFrames() const { return ungated_frames_; }
+    uint64_t GatedFrames() const { return gated_frames_; }
+
     /** @brief Add a new identity to the face database. */
     int AddIdentity(const std::string& name);
 
     /** @brief Add an embedding to an existing identity. */
     void AddEmbeddingToIdentity(int id, const std::vector<float>& embedding);
 
+    /** @brief Match an identity against its own threshold instead of the global one, e.g. a stricter watchlist bar. */
+    void SetIdentityThreshold(int id, float threshold);
+
+    /** @brief Put an identity on the watchlist, which every face is checked against first. */
+    void SetWatchlist(int id, bool watchlist);
+
 private:
+    /** @brief Per-frame detector input and output, allocated once and bound to every session. */
+    struct FrameSlot
+    {
+        AlignedBuffer<float> input_tensor;
+        std::vector<AlignedBuffer<float>> outputs; // the _post output, or every raw head
+        Ort::Value input_value{nullptr};
+        std::vector<Ort::Value> output_values;
+        bool output_valid = false;
+        std::vector<std::pair<Ort::Session *, Ort::IoBinding>> bindings;
+    };
+
     /** @brief Structure representing per-layer information of face detection output. */
     struct LayerParams
     {
@@ -66,35 +178,48 @@ private:
     void Init(size_t accl_input_width, size_t accl_input_height, size_t accl_input_channel,
               float confidence_thresh);
 
-    /** @brief Helper methods for building face detections from model output. */
-    void GetFaceDetection(std::queue<FaceBox> &face_boxes, int layer_id,
-                         float *confidence_buffer, float *bbox_buffer, float *keypoint_buffer,
-                         int row, int col);
+    /** @brief Map the raw stride-8/16/32 head outputs of a headless detector onto face_detection_layers_. */
+    void AssignRawHeadOutputs();
 
-    /** @brief Helper methods for calculating face bounding box parameters. */
-    void CalculateFaceParams(const float *feature_values, int layer_id, int row, int col,
-                            float &center_x, float &center_y, float &box_width, float &box_height);
+    /** @brief Decode the three raw heads of one image, skipping sub-threshold cells in logit space. */
+    void ProcessRawHeadOutput(const FrameSlot &slot, FaceRecognitionResult &result);
 
-    /** @brief Extract face region for recognition. */
-    cv::Mat ExtractFace(const cv::Mat& image, const FaceBox& face_box,
-                       const std::vector<FaceKeypoint>& keypoints);
+    /** @brief Helper methods for building face detections of the candidate cells of one layer. */
+    void GetFaceDetection(std::vector<FaceBox> &faces, int layer_id,
+                         const float *confidence_buffer, const float *bbox_buffer, const float *keypoint_buffer,
+                         const int32_t *cells, size_t num_cells);
 
-    /** @brief Process face recognition embedding from cropped face. */
-    void ProcessFaceEmbedding(const cv::Mat& face_image, std::vector<float>& embedding,
-                             std::vector<float *> output_buffers);
+    /** @brief Helper methods for calculating face bounding box parameters of the candidate cells of one layer. */
+    void CalculateFaceParams(const float *bbox_buffer, int layer_id, const int32_t *cells, size_t num_cells,
+                            float *center_x, float *center_y, float *box_width, float *box_height);
 
-    /** @brief Process ONNX model output for face detection. */
-    void ProcessDetectionOutput(std::vector<Ort::Value>& output_tensors, FaceRecognitionResult &result);
+    /** @brief Embed the listed faces of the frame in one batch and assign their identities. */
+    void ProcessFaceEmbedding(const cv::Mat& image, FaceRecognitionResult &result,
+                              const int32_t *faces, size_t count);
 
-    /** @brief Apply Non-Maximum Suppression to face detections. */
-    void ApplyNMS(std::vector<FaceBox>& faces, float iou_threshold = 0.45f);
+    /** @brief Map boxes and keypoints from model input coordinates back to the display image. */
+    void ScaleToDisplay(FaceRecognitionResult &result);
 
-    /** @brief Calculate IoU between two face boxes. */
-    float CalculateIoU(const FaceBox& box1, const FaceBox& box2);
+    /** @brief Process ONNX model output of one image for face detection. */
+    void ProcessDetectionOutput(const float *output_data, const std::vector<int64_t> &output_shape,
+                                FaceRecognitionResult &result);
+
+    /** @brief Apply Non-Maximum Suppression to face detections, leaving the survivors by descending confidence. */
+    void ApplyNMS(std::vector<FaceBox>& faces, float iou_threshold = kNmsIouThreshold);
+
+    /** @brief Get a slot's IoBinding for a pooled session, creating it on first use. */
+    Ort::IoBinding &GetBinding(Ort::Session &session, FrameSlot &slot);
 
     static constexpr size_t kNumPostProcessLayers = 3;
     struct LayerParams face_detection_layers_[kNumPostProcessLayers];
 
+    // NMS overlap limit, and the best candidates considered so low thresholds stay cheap
+    static constexpr float kNmsIouThreshold = 0.45f;
+    static constexpr size_t kMaxNmsCandidates = 1024;
+    static constexpr int kMotionGateWidth = 64;  // motion thumbnail, about 16:9
+    static constexpr int kMotionGateHeight = 36;
+    static constexpr float kWatchlistConfidentMargin = 0.1f; // watchlist hits skipping the full gallery
+
     // Model-specific parameters
     size_t accl_input_width_;   // Input width to accelerator
     size_t accl_input_height_;  // Input height to accelerator
@@ -116,17 +241,70 @@ private:
     int padding_width_;
     bool valid_input_;
 
-    // Face database for identity management
-    FaceDatabase face_database_;
+    // Fused resize/pad/normalize/CHW kernel, tables rebuilt only when the viewer size changes
+    LetterboxKernel letterbox_kernel_;
+
+    // Face database for identity management, private unless UseGallery() shares one
+    std::shared_ptr<SharedGallery> gallery_;
+
+    // Batched embedding stage, null until EnableRecognition()
+    std::unique_ptr<FaceEmbedder> face_embedder_;
+    float match_threshold_;
+    FaceQualityScorer quality_scorer_;
+    float min_quality_;
+    std::vector<int32_t> recognition_faces_; // faces embedded this frame
+    std::vector<float> face_quality_;        // per face of the frame, for the bar and the cache
+    std::vector<float> match_queries_;       // embeddings of recognition_faces_, matched as one batch
+    std::vector<FaceMatch> matches_;
+    std::vector<size_t> full_faces_;  // indices into matches_ of faces missing the watchlist
+    std::vector<float> full_queries_; // and their embeddings, searched in the full gallery
+    std::vector<FaceMatch> full_matches_;
+
+    // Tracker, null until EnableTracking(); the frame counter belongs to the capture thread
+    std::unique_ptr<FaceTracker> tracker_;
+    RecognitionCache recognition_cache_;
+    size_t detect_interval_;
+    size_t cold_interval_;
+    size_t frame_counter_;
 
-    // ONNX Runtime session and environment
-    Ort::Env ort_env_;
-    Ort::Session ort_session_;
+    // Motion gate, null until EnableMotionGate(); runs on the capture thread, while the number of
+    // faces in view is written by the tracking stage, which may run a few frames behind
+    std::unique_ptr<MotionGate> motion_gate_;
+    size_t heartbeat_frames_;
+    size_t frames_since_detection_;
+    bool motion_pending_;
+    int untracked_faces_; // detections of the last detection frame that got no track
+    std::atomic<int> faces_in_view_;
+    std::atomic<uint64_t> ungated_frames_;
+    std::atomic<uint64_t> gated_frames_;
+
+    // Detector sessions shared with the other channels
+    SessionPool &detector_pool_;
+    FaceBatcher *batcher_;
     Ort::MemoryInfo memory_info_;
 
-    // Model input/output names and shapes
-    std::vector<const char*> input_names_;
-    std::vector<const char*> output_names_;
-    std::vector<std::vector<int64_t>> input_shapes_;
-    std::vector<std::vector<int64_t>> output_shapes_;
+    // Per-channel detector inputs and outputs, one per frame in flight
+    std::vector<int64_t> input_shape_;
+    std::vector<std::vector<int64_t>> output_shapes_; // shapes of the outputs bound in every slot
+    std::vector<FrameSlot> slots_;
+
+    // Headless detector decoded by ProcessRawHeadOutput instead of the in-graph post-process,
+    // with heads laid out [1, H, W, C] or, for NCHW exports, [1, C, H, W]
+    bool raw_heads_;
+    bool raw_heads_nchw_;
+
+    /** @brief Offset of one channel of a grid cell in a raw head of the given channel and cell counts. */
+    size_t RawHeadOffset(size_t cell, size_t channel, size_t channels, size_t cells) const
+    {
+        return raw_heads_nchw_ ? channel * cells + cell : cell * channels + channel;
+    }
+
+    // Decoder scratch: anchors above the confidence threshold, and the raw-head gather buffers
+    AlignedBuffer<int32_t> candidate_cells_;
+    AlignedBuffer<float> decode_scratch_;
+
+    // Sweep-and-prune NMS shared by both decode paths
+    NmsEngine nms_;
+    std::vector<FaceBox> nms_faces_;
+    std::vector<FaceBox> decoded_faces_; // raw-head candidates before NMS
 };
\ No newline at end of file
@@ -0,0 +1,220 @@
+#include "face_tracker.h"
+#include <algorithm>
+
+namespace {
+
+// Noise relative to the face height, as in ByteTrack
+constexpr float kPositionWeight = 1.0f / 20.0f;
+constexpr float kVelocityWeight = 1.0f / 160.0f;
+
+// Weak detections continue a track only when they overlap it clearly
+constexpr float kLowScoreMatchIou = 0.5f;
+
+inline float IoU(float ax1, float ay1, float ax2, float ay2, float bx1, float by1, float bx2, float by2)
+{
+    const float iw = std::min(ax2, bx2) - std::max(ax1, bx1);
+    const float ih = std::min(ay2, by2) - std::max(ay1, by1);
+    if (iw <= 0.0f || ih <= 0.0f) {
+        return 0.0f;
+    }
+    const float intersection = iw * ih;
+    const float union_area = (ax2 - ax1) * (ay2 - ay1) + (bx2 - bx1) * (by2 - by1) - intersection;
+    return union_area > 0.0f ? intersection / union_area : 0.0f;
+}
+
+} // namespace
+
+void FaceTracker::KalmanAxis::Init(float value, float position_std, float velocity_std)
+{
+    x = value;
+    v = 0.0f;
+    p00 = position_std * position_std;
+    p01 = 0.0f;
+    p11 = velocity_std * velocity_std;
+}
+
+void FaceTracker::KalmanAxis::Predict(float position_var, float velocity_var)
+{
+    // x' = x + v, P' = F P F^T + Q
+    x += v;
+    p00 += 2.0f * p01 + p11 + position_var;
+    p01 += p11;
+    p11 += velocity_var;
+}
+
+void FaceTracker::KalmanAxis::Correct(float value, float measurement_var)
+{
+    const float s = p00 + measurement_var;
+    const float k0 = p00 / s;
+    const float k1 = p01 / s;
+    const float innovation = value - x;
+    x += k0 * innovation;
+    v += k1 * innovation;
+    p11 -= k1 * p01;
+    p00 -= k0 * p00;
+    p01 -= k0 * p01;
+}
+
+FaceTracker::FaceTracker(float high_score, float match_iou, int max_lost_frames)
+    : high_score_(high_score), match_iou_(match_iou), max_lost_frames_(max_lost_frames), next_id_(0)
+{
+}
+
+void FaceTracker::Update(FaceRecognitionResult &result)
+{
+    PredictTracks();
+
+    track_match_.assign(tracks_.size(), -1);
+    detection_match_.assign(result.num_faces, -1);
+
+    // Confident detections may take any track, then weak ones may continue the tracks still active
+    Associate(result, true, match_iou_);
+    Associate(result, false, kLowScoreMatchIou);
+
+    for (size_t t = 0; t < tracks_.size(); t++) {
+        Track &track = tracks_[t];
+        if (track_match_[t] >= 0) {
+            CorrectTrack(track, result, track_match_[t]);
+        }
+        else {
+            track.active = false;
+        }
+    }
+    RemoveLostTracks();
+
+    for (int d = 0; d < result.num_faces; d++) {
+        if (detection_match_[d] >= 0) {
+            result.track_id[d] = detection_match_[d];
+        }
+        else if (result.confidence[d] >= high_score_) {
+            StartTrack(result, d);
+            result.track_id[d] = tracks_.back().id;
+        }
+    }
+}
+
+void FaceTracker::Predict(FaceRecognitionResult &result)
+{
+    PredictTracks();
+    RemoveLostTracks();
+
+    result.clear();
+    result.detected = false;
+    for (const Track &track : tracks_) {
+        if (!track.active) {
+            continue;
+        }
+
+        const float cx = track.center_x.x, cy = track.center_y.x;
+        const float w = std::max(track.width.x, 1.0f), h = std::max(track.height.x, 1.0f);
+        FaceBox face(track.confidence, cx - w / 2.0f, cy - h / 2.0f, cx + w / 2.0f, cy + h / 2.0f);
+
+        // Landmarks keep their place relative to the box they were detected in
+        const float scale_x = w / track.detected_w, scale_y = h / track.detected_h;
+        for (size_t kp = 0; kp < kNumFaceKeypoints; kp++) {
+            face.keypoints[kp] = FaceKeypoint(cx + (track.keypoints[kp].x - track.detected_cx) * scale_x,
+                                              cy + (track.keypoints[kp].y - track.detected_cy) * scale_y,
+                                              track.keypoints[kp].confidence);
+        }
+        face.track_id = track.id;
+        result.add_face(face);
+    }
+}
+
+void FaceTracker::PredictTracks()
+{
+    for (Track &track : tracks_) {
+        const float position_std = kPositionWeight * track.height.x;
+        const float velocity_std = kVelocityWeight * track.height.x;
+        const float position_var = position_std * position_std;
+        const float velocity_var = velocity_std * velocity_std;
+        track.center_x.Predict(position_var, velocity_var);
+        track.center_y.Predict(position_var, velocity_var);
+        track.width.Predict(position_var, velocity_var);
+        track.height.Predict(position_var, velocity_var);
+
+        track.frames_since_update++;
+    }
+}
+
+void FaceTracker::Associate(const FaceRecognitionResult &result, bool confident, float min_iou)
+{
+    matches_.clear();
+    for (size_t t = 0; t < tracks_.size(); t++) {
+        const Track &track = tracks_[t];
+        if (track_match_[t] >= 0 || (!confident && !track.active)) {
+            continue;
+        }
+        const float half_w = track.width.x / 2.0f, half_h = track.height.x / 2.0f;
+        const float tx1 = track.center_x.x - half_w, ty1 = track.center_y.x - half_h;
+        const float tx2 = track.center_x.x + half_w, ty2 = track.center_y.x + half_h;
+
+        for (int d = 0; d < result.num_faces; d++) {
+            if (detection_match_[d] >= 0 || (result.confidence[d] >= high_score_) != confident) {
+                continue;
+            }
+            float iou = IoU(tx1, ty1, tx2, ty2, result.x_min[d], result.y_min[d], result.x_max[d], result.y_max[d]);
+            if (iou >= min_iou) {
+                matches_.push_back({iou, static_cast<int32_t>(t), d});
+            }
+        }
+    }
+
+    // Greedy assignment by overlap, which matches the optimal one for the sparse overlaps of faces
+    std::sort(matches_.begin(), matches_.end(), [](const Match &a, const Match &b) { return a.iou > b.iou; });
+    for (const Match &match : matches_) {
+        if (track_match_[match.track] < 0 && detection_match_[match.detection] < 0) {
+            track_match_[match.track] = match.detection;
+            detection_match_[match.detection] = tracks_[match.track].id;
+        }
+    }
+}
+
+void FaceTracker::StartTrack(const FaceRecognitionResult &result, size_t detection)
+{
+    Track track;
+    track.id = next_id_++;
+    const float w = result.x_max[detection] - result.x_min[detection];
+    const float h = result.y_max[detection] - result.y_min[detection];
+    const float position_std = 2.0f * kPositionWeight * h;
+    const float velocity_std = 10.0f * kVelocityWeight * h;
+    track.center_x.Init(result.x_min[detection] + w / 2.0f, position_std, velocity_std);
+    track.center_y.Init(result.y_min[detection] + h / 2.0f, position_std, velocity_std);
+    track.width.Init(w, position_std, velocity_std);
+    track.height.Init(h, position_std, velocity_std);
+
+    tracks_.push_back(track);
+    CorrectTrack(tracks_.back(), result, detection);
+}
+
+void FaceTracker::CorrectTrack(Track &track, const FaceRecognitionResult &result, size_t detection)
+{
+    const float w = result.x_max[detection] - result.x_min[detection];
+    const float h = result.y_max[detection] - result.y_min[detection];
+    const float cx = result.x_min[detection] + w / 2.0f;
+    const float cy = result.y_min[detection] + h / 2.0f;
+
+    const float measurement_std = kPositionWeight * h;
+    const float measurement_var = measurement_std * measurement_std;
+    track.center_x.Correct(cx, measurement_var);
+    track.center_y.Correct(cy, measurement_var);
+    track.width.Correct(w, measurement_var);
+    track.height.Correct(h, measurement_var);
+
+    track.detected_cx = cx;
+    track.detected_cy = cy;
+    track.detected_w = std::max(w, 1.0f);
+    track.detected_h = std::max(h, 1.0f);
+    std::copy(result.face_keypoints(detection), result.face_keypoints(detection) + kNumFaceKeypoints,
+              track.keypoints);
+    track.confidence = result.confidence[detection];
+    track.frames_since_update = 0;
+    track.active = true;
+}
+
+void FaceTracker::RemoveLostTracks()
+{
+    tracks_.erase(std::remove_if(tracks_.begin(), tracks_.end(),
+                                 [this](const Track &track) { return track.frames_since_update > max_lost_frames_; }),
+                  tracks_.end());
+}
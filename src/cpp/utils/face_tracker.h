@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "face_core.h"
+
+/**
+ * @brief ByteTrack-style multi-face tracker with a constant-velocity Kalman filter per track.
+ *
+ * Update() associates the detections of a frame with the predicted tracks by IoU, the
+ * confident detections first and then the weaker ones, which may continue a track but
+ * never start one, and writes every face's track ID. Predict() advances the tracks over a
+ * frame the detector skipped and writes their propagated boxes and keypoints instead.
+ * Identities are cached per track ID by RecognitionCache.
+ *
+ * One tracker per channel; frames must be passed in order from a single thread.
+ */
+class FaceTracker
+{
+public:
+    /**
+     * @param high_score       Detections at or above this score start tracks; weaker ones only continue them.
+     *                         The detector's confidence threshold lets every reported face start a track.
+     * @param match_iou        Min IoU between a predicted track and a confident detection to associate them.
+     * @param max_lost_frames  Frames a track survives without a matching detection.
+     */
+    explicit FaceTracker(float high_score = 0.6f, float match_iou = 0.3f, int max_lost_frames = 30);
+
+    /** @brief Associate the detections in result with the tracks and fill their track_id. */
+    void Update(FaceRecognitionResult &result);
+
+    /** @brief Replace result with the tracks propagated one frame, for frames without detection. */
+    void Predict(FaceRecognitionResult &result);
+
+    /** @brief Change the start score, e.g. to follow the detector's confidence threshold. */
+    void SetHighScore(float high_score) { high_score_ = high_score; }
+
+    size_t NumTracks() const { return tracks_.size(); }
+
+private:
+    // Position and velocity of one box coordinate
+    struct KalmanAxis
+    {
+        float x, v;
+        float p00, p01, p11; // covariance
+
+        void Init(float value, float position_std, float velocity_std);
+        void Predict(float position_var, float velocity_var);
+        void Correct(float value, float measurement_var);
+    };
+
+    struct Track
+    {
+        int id;
+        KalmanAxis center_x, center_y, width, height;
+        // Box and landmarks of the last matched detection; predicted keypoints follow the box from here
+        float detected_cx, detected_cy, detected_w, detected_h;
+        FaceKeypoint keypoints[kNumFaceKeypoints];
+        float confidence;
+        int frames_since_update;
+        bool active; // matched by the most recent detection frame
+    };
+
+    struct Match
+    {
+        float iou;
+        int32_t track;
+        int32_t detection;
+    };
+
+    void PredictTracks();
+    void Associate(const FaceRecognitionResult &result, bool confident, float min_iou);
+    void StartTrack(const FaceRecognitionResult &result, size_t detection);
+    void CorrectTrack(Track &track, const FaceRecognitionResult &result, size_t detection);
+    void RemoveLostTracks();
+
+    float high_score_;
+    float match_iou_;
+    int max_lost_frames_;
+    int next_id_;
+
+    std::vector<Track> tracks_;
+
+    // Association scratch, reused every frame
+    std::vector<Match> matches_;
+    std::vector<int32_t> track_match_;     // detection matched to each track, -1 if none
+    std::vector<int32_t> detection_match_; // ID of the track matched to each detection, -1 if none
+};
@@ -0,0 +1,369 @@
+#include "hnsw_index.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <queue>
+#include "simd_dot.h"
+
+namespace {
+
+constexpr uint32_t kIndexMagic = 0x57534e48; // "HNSW"
+constexpr uint32_t kIndexVersion = 1;
+constexpr int kMaxLevel = 16;
+
+inline float Similarity(const HnswVectors &vectors, size_t size, const float *query, uint32_t row)
+{
+    float similarity;
+    DotRows<1>(query, size, vectors.Row(row), vectors.stride, &similarity);
+    return similarity;
+}
+
+// Per-thread visited marks, reset in O(1) by bumping the epoch
+struct VisitedSet
+{
+    std::vector<uint32_t> marks;
+    uint32_t epoch = 0;
+
+    void Reset(size_t count)
+    {
+        if (marks.size() < count) {
+            marks.resize(count, 0);
+        }
+        if (++epoch == 0) {
+            std::fill(marks.begin(), marks.end(), 0);
+            epoch = 1;
+        }
+    }
+
+    bool Insert(uint32_t node)
+    {
+        if (marks[node] == epoch) {
+            return false;
+        }
+        marks[node] = epoch;
+        return true;
+    }
+};
+
+template <typename T>
+void WritePod(std::ostream &out, const T &value)
+{
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+void WriteVector(std::ostream &out, const std::vector<T> &values)
+{
+    WritePod(out, static_cast<uint64_t>(values.size()));
+    out.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename T>
+bool ReadPod(std::istream &in, T &value)
+{
+    return static_cast<bool>(in.read(reinterpret_cast<char *>(&value), sizeof(T)));
+}
+
+template <typename T>
+bool ReadVector(std::istream &in, std::vector<T> &values, uint64_t max_count)
+{
+    uint64_t count;
+    if (!ReadPod(in, count) || count > max_count) {
+        return false;
+    }
+    values.resize(count);
+    return static_cast<bool>(in.read(reinterpret_cast<char *>(values.data()), count * sizeof(T)));
+}
+
+} // namespace
+
+HnswIndex::HnswIndex(size_t m, size_t ef_construction, size_t ef_search)
+    : m_(std::max<size_t>(m, 2)), m0_(2 * m_), ef_construction_(std::max(ef_construction, m_)),
+      ef_search_(ef_search > 0 ? ef_search : 1), level_scale_(1.0 / std::log(static_cast<double>(m_))),
+      rng_(0x5eed), entry_(0), max_level_(-1)
+{
+}
+
+uint32_t *HnswIndex::Links(uint32_t node, int level)
+{
+    if (level == 0) {
+        return bottom_links_.data() + static_cast<size_t>(node) * (m0_ + 1);
+    }
+    return upper_links_[node].data() + static_cast<size_t>(level - 1) * (m_ + 1);
+}
+
+const uint32_t *HnswIndex::Links(uint32_t node, int level) const
+{
+    return const_cast<HnswIndex *>(this)->Links(node, level);
+}
+
+void HnswIndex::Add(const HnswVectors &vectors, size_t size)
+{
+    const uint32_t node = static_cast<uint32_t>(levels_.size());
+    const float *query = vectors.Row(node);
+
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    const double draw = std::max(uniform(rng_), 1e-12);
+    const int level = std::min(static_cast<int>(-std::log(draw) * level_scale_), kMaxLevel);
+
+    levels_.push_back(static_cast<uint8_t>(level));
+    bottom_links_.resize(bottom_links_.size() + m0_ + 1, 0);
+    upper_links_.emplace_back(static_cast<size_t>(level) * (m_ + 1), 0);
+
+    if (max_level_ < 0) {
+        entry_ = node;
+        max_level_ = level;
+        return;
+    }
+
+    // Greedy descent through the layers above the new node's top layer
+    uint32_t entry = entry_;
+    float entry_similarity = Similarity(vectors, size, query, entry);
+    for (int l = max_level_; l > level; l--) {
+        bool improved = true;
+        while (improved) {
+            improved = false;
+            const uint32_t *links = Links(entry, l);
+            for (uint32_t i = 1; i <= links[0]; i++) {
+                const float similarity = Similarity(vectors, size, query, links[i]);
+                if (similarity > entry_similarity) {
+                    entry_similarity = similarity;
+                    entry = links[i];
+                    improved = true;
+                }
+            }
+        }
+    }
+
+    std::vector<Candidate> found;
+    std::vector<uint32_t> selected;
+    for (int l = std::min(level, max_level_); l >= 0; l--) {
+        SearchLayer(vectors, size, query, entry, ef_construction_, l, found);
+        SelectNeighbors(vectors, size, found, m_, selected);
+
+        uint32_t *links = Links(node, l);
+        links[0] = static_cast<uint32_t>(selected.size());
+        std::copy(selected.begin(), selected.end(), links + 1);
+        for (uint32_t neighbor : selected) {
+            Connect(vectors, size, neighbor, node, l);
+        }
+        entry = found.front().second;
+    }
+
+    if (level > max_level_) {
+        entry_ = node;
+        max_level_ = level;
+    }
+}
+
+void HnswIndex::Connect(const HnswVectors &vectors, size_t size, uint32_t node, uint32_t neighbor, int level)
+{
+    uint32_t *links = Links(node, level);
+    const size_t max_links = MaxLinks(level);
+    if (links[0] < max_links) {
+        links[++links[0]] = neighbor;
+        return;
+    }
+
+    // Full: re-select among the current links and the new one, as seen from this node
+    const float *base = vectors.Row(node);
+    std::vector<Candidate> candidates;
+    candidates.reserve(max_links + 1);
+    candidates.emplace_back(Similarity(vectors, size, base, neighbor), neighbor);
+    for (uint32_t i = 1; i <= links[0]; i++) {
+        candidates.emplace_back(Similarity(vectors, size, base, links[i]), links[i]);
+    }
+    std::sort(candidates.begin(), candidates.end(), std::greater<Candidate>());
+
+    std::vector<uint32_t> selected;
+    SelectNeighbors(vectors, size, candidates, max_links, selected);
+    links[0] = static_cast<uint32_t>(selected.size());
+    std::copy(selected.begin(), selected.end(), links + 1);
+}
+
+void HnswIndex::SelectNeighbors(const HnswVectors &vectors, size_t size, const std::vector<Candidate> &sorted,
+                                size_t max_links, std::vector<uint32_t> &selected) const
+{
+    selected.clear();
+    for (const Candidate &candidate : sorted) {
+        if (selected.size() >= max_links) {
+            break;
+        }
+        // Skip candidates better reached through a neighbor already kept
+        const float *candidate_vector = vectors.Row(candidate.second);
+        bool diverse = true;
+        for (uint32_t kept : selected) {
+            if (Similarity(vectors, size, candidate_vector, kept) > candidate.first) {
+                diverse = false;
+                break;
+            }
+        }
+        if (diverse) {
+            selected.push_back(candidate.second);
+        }
+    }
+}
+
+void HnswIndex::SearchLayer(const HnswVectors &vectors, size_t size, const float *query, uint32_t entry,
+                            size_t ef, int level, std::vector<Candidate> &found) const
+{
+    thread_local VisitedSet visited;
+    visited.Reset(levels_.size());
+
+    // Candidates to expand, best first; results kept, worst first
+    std::priority_queue<Candidate> candidates;
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> results;
+
+    const float entry_similarity = Similarity(vectors, size, query, entry);
+    visited.Insert(entry);
+    candidates.emplace(entry_similarity, entry);
+    results.emplace(entry_similarity, entry);
+
+    while (!candidates.empty()) {
+        const Candidate current = candidates.top();
+        if (current.first < results.top().first && results.size() >= ef) {
+            break;
+        }
+        candidates.pop();
+
+        const uint32_t *links = Links(current.second, level);
+        for (uint32_t i = 1; i <= links[0]; i++) {
+            const uint32_t neighbor = links[i];
+            if (!visited.Insert(neighbor)) {
+                continue;
+            }
+            const float similarity = Similarity(vectors, size, query, neighbor);
+            if (results.size() < ef || similarity > results.top().first) {
+                candidates.emplace(similarity, neighbor);
+                results.emplace(similarity, neighbor);
+                if (results.size() > ef) {
+                    results.pop();
+                }
+            }
+        }
+    }
+
+    found.resize(results.size());
+    for (size_t i = found.size(); i-- > 0;) {
+        found[i] = results.top();
+        results.pop();
+    }
+}
+
+size_t HnswIndex::Search(const HnswVectors &vectors, size_t size, const float *query, size_t k,
+                         uint32_t *rows, float *similarities) const
+{
+    if (max_level_ < 0 || k == 0) {
+        return 0;
+    }
+
+    uint32_t entry = entry_;
+    float entry_similarity = Similarity(vectors, size, query, entry);
+    for (int l = max_level_; l > 0; l--) {
+        bool improved = true;
+        while (improved) {
+            improved = false;
+            const uint32_t *links = Links(entry, l);
+            for (uint32_t i = 1; i <= links[0]; i++) {
+                const float similarity = Similarity(vectors, size, query, links[i]);
+                if (similarity > entry_similarity) {
+                    entry_similarity = similarity;
+                    entry = links[i];
+                    improved = true;
+                }
+            }
+        }
+    }
+
+    thread_local std::vector<Candidate> found;
+    SearchLayer(vectors, size, query, entry, std::max(k, ef_search_), 0, found);
+    const size_t count = std::min(k, found.size());
+    for (size_t i = 0; i < count; i++) {
+        similarities[i] = found[i].first;
+        rows[i] = found[i].second;
+    }
+    return count;
+}
+
+bool HnswIndex::Save(std::ostream &out) const
+{
+    WritePod(out, kIndexMagic);
+    WritePod(out, kIndexVersion);
+    WritePod(out, static_cast<uint64_t>(m_));
+    WritePod(out, static_cast<uint64_t>(ef_construction_));
+    WritePod(out, static_cast<uint64_t>(ef_search_));
+    WritePod(out, entry_);
+    WritePod(out, static_cast<int32_t>(max_level_));
+    WriteVector(out, levels_);
+    WriteVector(out, bottom_links_);
+    for (const std::vector<uint32_t> &links : upper_links_) {
+        out.write(reinterpret_cast<const char *>(links.data()), links.size() * sizeof(uint32_t));
+    }
+    return static_cast<bool>(out);
+}
+
+bool HnswIndex::Load(std::istream &in)
+{
+    uint32_t magic, version, entry;
+    uint64_t m, ef_construction, ef_search;
+    int32_t max_level;
+    if (!ReadPod(in, magic) || magic != kIndexMagic || !ReadPod(in, version) || version != kIndexVersion ||
+        !ReadPod(in, m) || !ReadPod(in, ef_construction) || !ReadPod(in, ef_search) || m < 2 || m > 1024 ||
+        !ReadPod(in, entry) || !ReadPod(in, max_level) || max_level > kMaxLevel) {
+        return false;
+    }
+
+    std::vector<uint8_t> levels;
+    std::vector<uint32_t> bottom_links;
+    if (!ReadVector(in, levels, UINT32_MAX) ||
+        !ReadVector(in, bottom_links, static_cast<uint64_t>(levels.size()) * (2 * m + 1)) ||
+        bottom_links.size() != levels.size() * (2 * m + 1) || (!levels.empty() && entry >= levels.size())) {
+        return false;
+    }
+    std::vector<std::vector<uint32_t>> upper_links(levels.size());
+    for (size_t node = 0; node < levels.size(); node++) {
+        if (levels[node] > kMaxLevel) {
+            return false;
+        }
+        upper_links[node].resize(static_cast<size_t>(levels[node]) * (m + 1));
+        if (!in.read(reinterpret_cast<char *>(upper_links[node].data()), upper_links[node].size() * sizeof(uint32_t))) {
+            return false;
+        }
+    }
+
+    // The entry point must sit on the top layer, and every link must name an existing node on
+    // its layer, so a damaged or crafted file cannot send a search out of bounds
+    const uint32_t count = static_cast<uint32_t>(levels.size());
+    if (count > 0 && (max_level < 0 || levels[entry] != max_level)) {
+        return false;
+    }
+    auto valid_links = [&levels, count](const uint32_t *links, size_t max_links, size_t level) {
+        return links[0] <= max_links &&
+               std::all_of(links + 1, links + 1 + links[0],
+                           [&levels, count, level](uint32_t node) { return node < count && levels[node] >= level; });
+    };
+    for (uint32_t node = 0; node < count; node++) {
+        if (!valid_links(bottom_links.data() + static_cast<size_t>(node) * (2 * m + 1), 2 * m, 0)) {
+            return false;
+        }
+        for (size_t l = 0; l < levels[node]; l++) {
+            if (!valid_links(upper_links[node].data() + l * (m + 1), m, l + 1)) {
+                return false;
+            }
+        }
+    }
+
+    m_ = m;
+    m0_ = 2 * m;
+    ef_construction_ = ef_construction;
+    ef_search_ = ef_search > 0 ? ef_search : 1;
+    level_scale_ = 1.0 / std::log(static_cast<double>(m_));
+    entry_ = entry;
+    max_level_ = levels.empty() ? -1 : max_level;
+    levels_ = std::move(levels);
+    bottom_links_ = std::move(bottom_links);
+    upper_links_ = std::move(upper_links);
+    return true;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <random>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Vector matrix of an HnswIndex: rows 64-byte aligned, stride floats apart, zero-padded
+ * past the vector size and L2-normalized. Rows [0, head_rows) are read from head and the rest
+ * from tail, so the matrix can grow without moving its first rows (e.g. those of a mapped file).
+ */
+struct HnswVectors
+{
+    const float *head;
+    size_t head_rows;
+    const float *tail;
+    size_t stride;
+
+    const float *Row(uint32_t row) const
+    {
+        return row < head_rows ? head + static_cast<size_t>(row) * stride
+                               : tail + static_cast<size_t>(row - head_rows) * stride;
+    }
+};
+
+/**
+ * @brief Hierarchical navigable small world graph for approximate inner-product search.
+ *
+ * The index stores only the graph: node i is row i of the caller's vector matrix, which is
+ * passed to every call, so the gallery keeps a single copy of its templates and may reallocate it.
+ * Rows are inserted incrementally in order. Each node links to at most m neighbors on its
+ * upper layers and 2 * m on the bottom layer, chosen with the HNSW diversity heuristic.
+ *
+ * Search() is const and safe to run concurrently; Add() is not.
+ */
+class HnswIndex
+{
+public:
+    /**
+     * @param m                Links per node and layer; higher raises recall, memory and build time.
+     * @param ef_construction  Candidate list size while inserting.
+     * @param ef_search        Candidate list size while searching; trades latency for recall.
+     */
+    explicit HnswIndex(size_t m = 16, size_t ef_construction = 200, size_t ef_search = 64);
+
+    /** @brief Insert row Size() of the vector matrix. */
+    void Add(const HnswVectors &vectors, size_t size);
+
+    /**
+     * @brief Rows with the largest inner product with the query, best first.
+     * @param k  Rows wanted; the search looks at max(k, ef_search) candidates.
+     * @return Number of rows written to rows and similarities.
+     */
+    size_t Search(const HnswVectors &vectors, size_t size, const float *query, size_t k,
+                  uint32_t *rows, float *similarities) const;
+
+    void SetEfSearch(size_t ef_search) { ef_search_ = ef_search > 0 ? ef_search : 1; }
+    size_t EfSearch() const { return ef_search_; }
+    size_t M() const { return m_; }
+    size_t Size() const { return levels_.size(); }
+
+    /** @brief Write the graph in a versioned binary layout. */
+    bool Save(std::ostream &out) const;
+
+    /** @brief Replace the graph with one written by Save(); false if the data is not a valid index. */
+    bool Load(std::istream &in);
+
+private:
+    using Candidate = std::pair<float, uint32_t>; // similarity, row
+
+    uint32_t *Links(uint32_t node, int level);
+    const uint32_t *Links(uint32_t node, int level) const;
+    size_t MaxLinks(int level) const { return level == 0 ? m0_ : m_; }
+
+    // Best-first search of one layer from entry; found is sorted best first
+    void SearchLayer(const HnswVectors &vectors, size_t size, const float *query, uint32_t entry,
+                     size_t ef, int level, std::vector<Candidate> &found) const;
+
+    // Keep up to max_links candidates that are closer to the base than to any kept one
+    void SelectNeighbors(const HnswVectors &vectors, size_t size, const std::vector<Candidate> &sorted,
+                         size_t max_links, std::vector<uint32_t> &selected) const;
+
+    void Connect(const HnswVectors &vectors, size_t size, uint32_t node, uint32_t neighbor, int level);
+
+    size_t m_;
+    size_t m0_;
+    size_t ef_construction_;
+    size_t ef_search_;
+    double level_scale_;
+    std::mt19937 rng_;
+
+    uint32_t entry_;
+    int max_level_;
+    std::vector<uint8_t> levels_;                    // top layer of every node
+    std::vector<uint32_t> bottom_links_;             // per node: count, then m0_ links
+    std::vector<std::vector<uint32_t>> upper_links_; // per node and layer above 0: count, then m_ links
+};
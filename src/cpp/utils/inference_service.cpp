@@ -0,0 +1,277 @@
+#include "inference_service.h"
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <filesystem>
+
+namespace {
+
+constexpr uint64_t kFnvOffset = 1469598103934665603ULL;
+constexpr uint64_t kFnvPrime = 1099511628211ULL;
+
+uint64_t HashBytes(const char *data, size_t size, uint64_t hash = kFnvOffset)
+{
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * kFnvPrime;
+    }
+    return hash;
+}
+
+// Content hash, so a re-exported model under the same name never reuses a stale cache
+uint64_t HashFile(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("cannot open model " + path);
+    }
+
+    std::vector<char> chunk(1 << 20);
+    uint64_t hash = kFnvOffset;
+    while (file) {
+        file.read(chunk.data(), chunk.size());
+        hash = HashBytes(chunk.data(), file.gcount(), hash);
+    }
+    return hash;
+}
+
+// Extended optimizations pick kernels and layouts for the host ISA
+std::string CpuFeatureKey()
+{
+    std::string key;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) key += "sse42.";
+    if (__builtin_cpu_supports("avx")) key += "avx.";
+    if (__builtin_cpu_supports("avx2")) key += "avx2.";
+    if (__builtin_cpu_supports("fma")) key += "fma.";
+    if (__builtin_cpu_supports("avx512f")) key += "avx512f.";
+    if (__builtin_cpu_supports("avx512bw")) key += "avx512bw.";
+    if (__builtin_cpu_supports("avx512vl")) key += "avx512vl.";
+    if (__builtin_cpu_supports("avx512vnni")) key += "avx512vnni.";
+    return key;
+}
+
+std::string Hex(uint64_t value, int digits)
+{
+    char text[17];
+    snprintf(text, sizeof(text), "%0*llx", digits, static_cast<unsigned long long>(value));
+    return std::string(text, digits);
+}
+
+double ElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+SessionPool::Lease::~Lease()
+{
+    if (session_) {
+        pool_->Return(session_);
+    }
+}
+
+SessionPool::SessionPool(Ort::Env &env, const std::string &model_path, const std::string &load_path,
+                         size_t num_sessions, const Ort::SessionOptions &session_options)
+    : model_path_(model_path)
+{
+    if (num_sessions == 0) {
+        throw std::invalid_argument("SessionPool requires at least one session.");
+    }
+
+    try {
+        for (size_t i = 0; i < num_sessions; i++) {
+            sessions_.push_back(std::make_unique<Ort::Session>(env, load_path.c_str(), session_options));
+            idle_sessions_.push_back(sessions_.back().get());
+        }
+
+        // Every session loads the same graph, so the first one describes them all
+        Ort::Session &session = *sessions_.front();
+        Ort::AllocatorWithDefaultOptions allocator;
+
+        for (size_t i = 0; i < session.GetInputCount(); i++) {
+            input_name_storage_.push_back(session.GetInputNameAllocated(i, allocator).get());
+            input_shapes_.push_back(session.GetInputTypeInfo(i).GetTensorTypeAndShapeInfo().GetShape());
+        }
+
+        for (size_t i = 0; i < session.GetOutputCount(); i++) {
+            output_name_storage_.push_back(session.GetOutputNameAllocated(i, allocator).get());
+            output_shapes_.push_back(session.GetOutputTypeInfo(i).GetTensorTypeAndShapeInfo().GetShape());
+        }
+    }
+    catch (const Ort::Exception& e) {
+        std::cerr << "Error loading ONNX model " << model_path << ": " << e.what() << std::endl;
+        throw;
+    }
+
+    for (const auto& name : input_name_storage_) {
+        input_names_.push_back(name.c_str());
+    }
+    for (const auto& name : output_name_storage_) {
+        output_names_.push_back(name.c_str());
+    }
+
+    std::cout << "Loaded ONNX model: " << model_path << " (" << num_sessions << " shared sessions, "
+              << input_names_.size() << " inputs, " << output_names_.size() << " outputs)" << std::endl;
+}
+
+SessionPool::Lease SessionPool::Borrow()
+{
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    idle_cv_.wait(lock, [this]() { return !idle_sessions_.empty(); });
+    Ort::Session *session = idle_sessions_.back();
+    idle_sessions_.pop_back();
+    return Lease(this, session);
+}
+
+void SessionPool::Return(Ort::Session *session)
+{
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex_);
+        idle_sessions_.push_back(session);
+    }
+    idle_cv_.notify_one();
+}
+
+InferenceService::InferenceService()
+    : intra_op_threads_(0),
+      sessions_per_model_(1)
+{
+}
+
+void InferenceService::Init(int intra_op_threads, size_t sessions_per_model, const std::string &cache_dir)
+{
+    if (env_) {
+        throw std::runtime_error("InferenceService is already initialized.");
+    }
+
+    intra_op_threads_ = (intra_op_threads > 0) ? intra_op_threads
+                                               : static_cast<int>(std::thread::hardware_concurrency());
+    sessions_per_model_ = (sessions_per_model > 0) ? sessions_per_model : 1;
+    cache_dir_ = cache_dir;
+
+    // One intra-op pool for the whole process; sessions opt out of their own pools below
+    Ort::ThreadingOptions threading_options;
+    threading_options.SetGlobalIntraOpNumThreads(intra_op_threads_);
+    threading_options.SetGlobalInterOpNumThreads(1);
+    env_ = std::make_unique<Ort::Env>(threading_options, ORT_LOGGING_LEVEL_WARNING, "InferenceService");
+
+    // Sessions created with session.use_env_allocators take their CPU memory from the pool
+    env_->RegisterAllocator(&allocator_);
+
+    printf("(Inference) global ORT pool: %d intra-op threads, %zu sessions per model\n",
+           intra_op_threads_, sessions_per_model_);
+}
+
+Ort::SessionOptions InferenceService::BaseSessionOptions()
+{
+    Ort::SessionOptions session_options;
+    session_options.DisablePerSessionThreads();
+    session_options.AddConfigEntry("session.use_env_allocators", "1");
+    return session_options;
+}
+
+std::string InferenceService::OptimizedModelPath(const std::string &model_path, bool &cache_hit)
+{
+    namespace fs = std::filesystem;
+    cache_hit = false;
+
+    if (cache_dir_.empty()) {
+        return model_path;
+    }
+
+    try {
+        const std::string stem = fs::path(model_path).stem().string();
+        const std::string path_key = Hex(HashBytes(model_path.data(), model_path.size()), 8);
+        const std::string environment = Ort::GetVersionString() + "|" + CpuFeatureKey() + "|extended";
+        const uint64_t key = HashBytes(environment.data(), environment.size(), HashFile(model_path));
+
+        const std::string prefix = stem + "-" + path_key + "-";
+        const fs::path cache_path = fs::path(cache_dir_) / (prefix + Hex(key, 16) + ".ort");
+
+        if (fs::exists(cache_path)) {
+            cache_hit = true;
+            return cache_path.string();
+        }
+
+        // Any other cache of this model was built for a different model, ORT or CPU
+        fs::create_directories(cache_dir_);
+        for (const auto& entry : fs::directory_iterator(cache_dir_)) {
+            const std::string name = entry.path().filename().string();
+            if (name.compare(0, prefix.size(), prefix) == 0 && entry.path() != cache_path) {
+                printf("(Inference) removing stale optimized model %s\n", entry.path().c_str());
+                fs::remove(entry.path());
+            }
+        }
+
+        // Optimize once and save the result; written under a temporary name so a crash never leaves half a cache
+        const fs::path temp_path = cache_path.string() + ".tmp";
+        auto start = std::chrono::steady_clock::now();
+        {
+            Ort::SessionOptions session_options = BaseSessionOptions();
+            session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
+            session_options.AddConfigEntry("session.save_model_format", "ORT");
+            session_options.SetOptimizedModelFilePath(temp_path.c_str());
+            Ort::Session session(*env_, model_path.c_str(), session_options);
+        }
+        fs::rename(temp_path, cache_path);
+        printf("(Inference) optimized %s in %.0f ms, cached as %s\n",
+               model_path.c_str(), ElapsedMs(start), cache_path.c_str());
+        return cache_path.string();
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Optimized model cache unavailable for " << model_path << ": " << e.what() << std::endl;
+        return model_path;
+    }
+}
+
+SessionPool &InferenceService::GetPool(const std::string &model_path)
+{
+    std::lock_guard<std::mutex> lock(pools_mutex_);
+
+    if (!env_) {
+        throw std::runtime_error("Make sure to call InferenceService::Init() before loading models.");
+    }
+
+    auto it = pools_.find(model_path);
+    if (it != pools_.end()) {
+        return *it->second;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bool cache_hit = false;
+    const std::string load_path = OptimizedModelPath(model_path, cache_hit);
+
+    std::unique_ptr<SessionPool> pool;
+    if (load_path != model_path) {
+        // Already optimized for this host, skip graph optimization entirely
+        Ort::SessionOptions session_options = BaseSessionOptions();
+        session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
+        session_options.AddConfigEntry("session.load_model_format", "ORT");
+        try {
+            pool = std::make_unique<SessionPool>(*env_, model_path, load_path, sessions_per_model_, session_options);
+        }
+        catch (const Ort::Exception& e) {
+            std::cerr << "Discarding unreadable optimized model " << load_path << ": " << e.what() << std::endl;
+            std::filesystem::remove(load_path);
+            cache_hit = false;
+        }
+    }
+
+    if (!pool) {
+        Ort::SessionOptions session_options = BaseSessionOptions();
+        session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
+        pool = std::make_unique<SessionPool>(*env_, model_path, model_path, sessions_per_model_, session_options);
+    }
+
+    printf("(Inference) %zu sessions of %s created in %.0f ms (optimized cache %s)\n",
+           sessions_per_model_, model_path.c_str(), ElapsedMs(start),
+           cache_dir_.empty() ? "disabled" : (cache_hit ? "hit" : "miss"));
+
+    SessionPool &pool_ref = *pool;
+    pools_.emplace(model_path, std::move(pool));
+    return pool_ref;
+}
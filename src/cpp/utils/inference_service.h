@@ -0,0 +1,123 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <onnxruntime_cxx_api.h>
+#include "pool_allocator.h"
+
+/**
+ * @brief A fixed set of ONNX Runtime sessions for one model, shared by all channels.
+ *
+ * Channels borrow a session for the duration of one Run() and give it back when the
+ * lease goes out of scope, so the model weights are loaded once per session instead
+ * of once per channel.
+ */
+class SessionPool
+{
+public:
+    /** @brief RAII handle on a borrowed session, returned to the pool on destruction. */
+    class Lease
+    {
+    public:
+        Lease(SessionPool *pool, Ort::Session *session) : pool_(pool), session_(session) {}
+        Lease(Lease &&other) noexcept : pool_(other.pool_), session_(other.session_) { other.session_ = nullptr; }
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+        ~Lease();
+
+        Ort::Session &operator*() { return *session_; }
+        Ort::Session *operator->() { return session_; }
+
+    private:
+        SessionPool *pool_;
+        Ort::Session *session_;
+    };
+
+    /**
+     * @param model_path    Model the pool serves, used as its name.
+     * @param load_path     File the sessions are created from, either model_path or its optimized cache.
+     */
+    SessionPool(Ort::Env &env, const std::string &model_path, const std::string &load_path,
+                size_t num_sessions, const Ort::SessionOptions &session_options);
+
+    /** @brief Borrow an idle session, blocking until one is available. */
+    Lease Borrow();
+
+    /** @brief Model input/output names and shapes, identical for every session in the pool. */
+    const std::vector<const char *> &InputNames() const { return input_names_; }
+    const std::vector<const char *> &OutputNames() const { return output_names_; }
+    const std::vector<std::vector<int64_t>> &InputShapes() const { return input_shapes_; }
+    const std::vector<std::vector<int64_t>> &OutputShapes() const { return output_shapes_; }
+
+    const std::string &ModelPath() const { return model_path_; }
+    size_t NumSessions() const { return sessions_.size(); }
+
+private:
+    void Return(Ort::Session *session);
+
+    std::string model_path_;
+    std::vector<std::unique_ptr<Ort::Session>> sessions_;
+
+    std::mutex idle_mutex_;
+    std::condition_variable idle_cv_;
+    std::vector<Ort::Session *> idle_sessions_;
+
+    // Name storage must outlive the const char* views handed to Run()
+    std::vector<std::string> input_name_storage_;
+    std::vector<std::string> output_name_storage_;
+    std::vector<const char *> input_names_;
+    std::vector<const char *> output_names_;
+    std::vector<std::vector<int64_t>> input_shapes_;
+    std::vector<std::vector<int64_t>> output_shapes_;
+};
+
+/**
+ * @brief Process-wide ONNX Runtime state: one Env with a global intra-op thread pool,
+ * a pooled allocator shared by all sessions, and one SessionPool per model path.
+ *
+ * When a cache directory is set, the graph optimized at ORT_ENABLE_EXTENDED is saved
+ * in ORT format under a name keyed by the model's content hash, the ORT version and
+ * the CPU feature set, and later starts load it with optimization disabled. A change
+ * of any key produces a different file name, so stale caches are never loaded.
+ */
+class InferenceService
+{
+public:
+    InferenceService();
+
+    /**
+     * @brief Create the shared ORT environment.
+     * @param intra_op_threads      Size of the global intra-op pool, 0 picks the number of hardware threads.
+     * @param sessions_per_model    Number of sessions created for each model.
+     * @param cache_dir             Directory for optimized-model caches, empty to always optimize at load.
+     */
+    void Init(int intra_op_threads, size_t sessions_per_model, const std::string &cache_dir = "");
+
+    /** @brief Get the session pool for a model, loading it on first use. */
+    SessionPool &GetPool(const std::string &model_path);
+
+    int IntraOpThreads() const { return intra_op_threads_; }
+
+    const PoolAllocator &Allocator() const { return allocator_; }
+
+private:
+    /** @brief Return the optimized cache of a model, creating it on a miss; falls back to model_path. */
+    std::string OptimizedModelPath(const std::string &model_path, bool &cache_hit);
+
+    /** @brief Options shared by every session, before optimization-level settings. */
+    Ort::SessionOptions BaseSessionOptions();
+
+    // Declared before env_ so it outlives every session that allocates from it
+    PoolAllocator allocator_;
+    std::unique_ptr<Ort::Env> env_;
+    int intra_op_threads_;
+    size_t sessions_per_model_;
+    std::string cache_dir_;
+
+    std::mutex pools_mutex_;
+    std::unordered_map<std::string, std::unique_ptr<SessionPool>> pools_;
+};
@@ -0,0 +1,232 @@
+#include "letterbox_kernel.h"
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+
+namespace {
+
+inline void FillRow(float *dst, int count, float value)
+{
+    std::fill(dst, dst + count, value);
+}
+
+// Same source coordinate mapping as cv::resize(INTER_LINEAR)
+inline void SourceCoord(int dst_idx, double scale, int src_size, int &idx0, int &idx1, float &weight)
+{
+    double src = (dst_idx + 0.5) * scale - 0.5;
+    int idx = static_cast<int>(std::floor(src));
+    double frac = src - idx;
+    if (idx < 0) {
+        idx = 0;
+        frac = 0.0;
+    }
+    if (idx >= src_size - 1) {
+        idx = src_size - 1;
+        frac = 0.0;
+    }
+    idx0 = idx;
+    idx1 = std::min(idx + 1, src_size - 1);
+    weight = static_cast<float>(frac);
+}
+
+#if defined(__AVX512F__)
+template <int kShift>
+inline __m512 Channel512(__m512i pixels)
+{
+    return _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(pixels, kShift), _mm512_set1_epi32(0xFF)));
+}
+
+template <int kShift>
+inline __m512 Blend512(__m512i p00, __m512i p01, __m512i p10, __m512i p11,
+                       __m512 wx0, __m512 wx1, __m512 wy0, __m512 wy1)
+{
+    __m512 top = _mm512_fmadd_ps(Channel512<kShift>(p01), wx1, _mm512_mul_ps(Channel512<kShift>(p00), wx0));
+    __m512 bottom = _mm512_fmadd_ps(Channel512<kShift>(p11), wx1, _mm512_mul_ps(Channel512<kShift>(p10), wx0));
+    return _mm512_fmadd_ps(bottom, wy1, _mm512_mul_ps(top, wy0));
+}
+#endif
+
+#if defined(__AVX2__) && defined(__FMA__)
+template <int kShift>
+inline __m256 Channel256(__m256i pixels)
+{
+    return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(pixels, kShift), _mm256_set1_epi32(0xFF)));
+}
+
+template <int kShift>
+inline __m256 Blend256(__m256i p00, __m256i p01, __m256i p10, __m256i p11,
+                       __m256 wx0, __m256 wx1, __m256 wy0, __m256 wy1)
+{
+    __m256 top = _mm256_fmadd_ps(Channel256<kShift>(p01), wx1, _mm256_mul_ps(Channel256<kShift>(p00), wx0));
+    __m256 bottom = _mm256_fmadd_ps(Channel256<kShift>(p11), wx1, _mm256_mul_ps(Channel256<kShift>(p10), wx0));
+    return _mm256_fmadd_ps(bottom, wy1, _mm256_mul_ps(top, wy0));
+}
+#endif
+
+} // namespace
+
+LetterboxKernel::LetterboxKernel()
+    : src_width_(0), src_height_(0), dst_width_(0), dst_height_(0),
+      letterbox_width_(0), letterbox_height_(0), pad_left_(0), pad_top_(0),
+      vector_cols_(0)
+{
+}
+
+void LetterboxKernel::Configure(int src_width, int src_height, int dst_width, int dst_height,
+                                int letterbox_width, int letterbox_height, int pad_left, int pad_top)
+{
+    if (src_width == src_width_ && src_height == src_height_ &&
+        dst_width == dst_width_ && dst_height == dst_height_ &&
+        letterbox_width == letterbox_width_ && letterbox_height == letterbox_height_ &&
+        pad_left == pad_left_ && pad_top == pad_top_) {
+        return;
+    }
+
+    src_width_ = src_width;
+    src_height_ = src_height;
+    dst_width_ = dst_width;
+    dst_height_ = dst_height;
+    letterbox_width_ = letterbox_width;
+    letterbox_height_ = letterbox_height;
+    pad_left_ = pad_left;
+    pad_top_ = pad_top;
+
+    const double scale_x = static_cast<double>(src_width) / letterbox_width;
+    const double scale_y = static_cast<double>(src_height) / letterbox_height;
+
+    x_offset0_.Resize(letterbox_width);
+    x_offset1_.Resize(letterbox_width);
+    x_weight_.Resize(letterbox_width);
+    vector_cols_ = letterbox_width;
+    for (int x = 0; x < letterbox_width; x++) {
+        int x0, x1;
+        float weight;
+        SourceCoord(x, scale_x, src_width, x0, x1, weight);
+        x_offset0_[x] = x0 * 3;
+        x_offset1_[x] = x1 * 3;
+        x_weight_[x] = weight;
+
+        // A 32-bit gather at the last pixel of the row would read one byte past it
+        if (x1 > src_width - 2 && vector_cols_ == letterbox_width) {
+            vector_cols_ = x;
+        }
+    }
+
+    y_row0_.Resize(letterbox_height);
+    y_row1_.Resize(letterbox_height);
+    y_weight0_.Resize(letterbox_height);
+    y_weight1_.Resize(letterbox_height);
+    for (int y = 0; y < letterbox_height; y++) {
+        int y0, y1;
+        float weight;
+        SourceCoord(y, scale_y, src_height, y0, y1, weight);
+        y_row0_[y] = y0;
+        y_row1_[y] = y1;
+        // Fold the 1/255 normalization into the vertical weights
+        y_weight0_[y] = (1.0f - weight) / 255.0f;
+        y_weight1_[y] = weight / 255.0f;
+    }
+}
+
+void LetterboxKernel::Run(const uint8_t *rgb_data, float *dst) const
+{
+    const size_t plane_size = static_cast<size_t>(dst_width_) * dst_height_;
+    const size_t src_stride = static_cast<size_t>(src_width_) * 3;
+    const int right_pad = dst_width_ - pad_left_ - letterbox_width_;
+
+    for (int y = 0; y < dst_height_; y++) {
+        float *dst_b = dst + y * dst_width_;
+        float *dst_g = dst_b + plane_size;
+        float *dst_r = dst_g + plane_size;
+
+        int ly = y - pad_top_;
+        if (ly < 0 || ly >= letterbox_height_) {
+            FillRow(dst_b, dst_width_, kPadValue);
+            FillRow(dst_g, dst_width_, kPadValue);
+            FillRow(dst_r, dst_width_, kPadValue);
+            continue;
+        }
+
+        for (float *plane : {dst_b, dst_g, dst_r}) {
+            FillRow(plane, pad_left_, kPadValue);
+            FillRow(plane + pad_left_ + letterbox_width_, right_pad, kPadValue);
+        }
+
+        RunRow(rgb_data + y_row0_[ly] * src_stride, rgb_data + y_row1_[ly] * src_stride,
+               y_weight0_[ly], y_weight1_[ly],
+               dst_b + pad_left_, dst_g + pad_left_, dst_r + pad_left_);
+    }
+}
+
+void LetterboxKernel::RunRow(const uint8_t *row0, const uint8_t *row1, float wy0, float wy1,
+                             float *dst_b, float *dst_g, float *dst_r) const
+{
+    int x = 0;
+
+    // Each gather fetches the 3 bytes of a source pixel (plus one spare byte) per lane,
+    // so four gathers give all taps of all channels for a block of output pixels
+#if defined(__AVX512F__)
+    {
+        const __m512 vwy0 = _mm512_set1_ps(wy0);
+        const __m512 vwy1 = _mm512_set1_ps(wy1);
+        const __m512 one = _mm512_set1_ps(1.0f);
+        for (; x + 16 <= vector_cols_; x += 16) {
+            __m512i o0 = _mm512_load_si512(x_offset0_.data() + x);
+            __m512i o1 = _mm512_load_si512(x_offset1_.data() + x);
+            __m512 wx1 = _mm512_load_ps(x_weight_.data() + x);
+            __m512 wx0 = _mm512_sub_ps(one, wx1);
+
+            __m512i p00 = _mm512_i32gather_epi32(o0, row0, 1);
+            __m512i p01 = _mm512_i32gather_epi32(o1, row0, 1);
+            __m512i p10 = _mm512_i32gather_epi32(o0, row1, 1);
+            __m512i p11 = _mm512_i32gather_epi32(o1, row1, 1);
+
+            _mm512_storeu_ps(dst_r + x, Blend512<0>(p00, p01, p10, p11, wx0, wx1, vwy0, vwy1));
+            _mm512_storeu_ps(dst_g + x, Blend512<8>(p00, p01, p10, p11, wx0, wx1, vwy0, vwy1));
+            _mm512_storeu_ps(dst_b + x, Blend512<16>(p00, p01, p10, p11, wx0, wx1, vwy0, vwy1));
+        }
+    }
+#endif
+
+#if defined(__AVX2__) && defined(__FMA__)
+    {
+        const __m256 vwy0 = _mm256_set1_ps(wy0);
+        const __m256 vwy1 = _mm256_set1_ps(wy1);
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const int *base0 = reinterpret_cast<const int *>(row0);
+        const int *base1 = reinterpret_cast<const int *>(row1);
+        for (; x + 8 <= vector_cols_; x += 8) {
+            __m256i o0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x_offset0_.data() + x));
+            __m256i o1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x_offset1_.data() + x));
+            __m256 wx1 = _mm256_loadu_ps(x_weight_.data() + x);
+            __m256 wx0 = _mm256_sub_ps(one, wx1);
+
+            __m256i p00 = _mm256_i32gather_epi32(base0, o0, 1);
+            __m256i p01 = _mm256_i32gather_epi32(base0, o1, 1);
+            __m256i p10 = _mm256_i32gather_epi32(base1, o0, 1);
+            __m256i p11 = _mm256_i32gather_epi32(base1, o1, 1);
+
+            _mm256_storeu_ps(dst_r + x, Blend256<0>(p00, p01, p10, p11, wx0, wx1, vwy0, vwy1));
+            _mm256_storeu_ps(dst_g + x, Blend256<8>(p00, p01, p10, p11, wx0, wx1, vwy0, vwy1));
+            _mm256_storeu_ps(dst_b + x, Blend256<16>(p00, p01, p10, p11, wx0, wx1, vwy0, vwy1));
+        }
+    }
+#endif
+
+    // Scalar tail, and the whole row on targets without AVX2
+    for (; x < letterbox_width_; x++) {
+        const uint8_t *p00 = row0 + x_offset0_[x];
+        const uint8_t *p01 = row0 + x_offset1_[x];
+        const uint8_t *p10 = row1 + x_offset0_[x];
+        const uint8_t *p11 = row1 + x_offset1_[x];
+        const float wx1 = x_weight_[x];
+        const float wx0 = 1.0f - wx1;
+
+        float *planes[3] = {dst_r, dst_g, dst_b};
+        for (int c = 0; c < 3; c++) {
+            float top = p00[c] * wx0 + p01[c] * wx1;
+            float bottom = p10[c] * wx0 + p11[c] * wx1;
+            planes[c][x] = top * wy0 + bottom * wy1;
+        }
+    }
+}
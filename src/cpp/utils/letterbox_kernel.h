@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "aligned_buffer.h"
+
+/**
+ * @brief Fused letterbox pre-processing for the face detector.
+ *
+ * Reads an interleaved RGB frame and writes the padded, 1/255-normalized, planar BGR
+ * float tensor in one pass, replacing cvtColor + resize + copyMakeBorder + convertTo +
+ * split + memcpy. Sampling matches cv::resize(INTER_LINEAR): the source coordinates and
+ * bilinear weights of every output column and row are precomputed by Configure() for
+ * the fixed viewer-to-model ratio, and Run() only gathers and blends.
+ */
+class LetterboxKernel
+{
+public:
+    LetterboxKernel();
+
+    /**
+     * @brief Build the coefficient tables; a no-op when the geometry is unchanged.
+     * @param src_width, src_height            Size of the RGB input frame.
+     * @param dst_width, dst_height            Size of the model input tensor.
+     * @param letterbox_width, letterbox_height Size of the scaled image inside the tensor.
+     * @param pad_left, pad_top                Offset of the scaled image inside the tensor.
+     */
+    void Configure(int src_width, int src_height, int dst_width, int dst_height,
+                   int letterbox_width, int letterbox_height, int pad_left, int pad_top);
+
+    /**
+     * @brief Write the CHW tensor for one frame.
+     * @param rgb_data  Interleaved RGB input of src_width * src_height pixels.
+     * @param dst       Output of 3 * dst_width * dst_height floats, planes ordered B, G, R.
+     */
+    void Run(const uint8_t *rgb_data, float *dst) const;
+
+    bool IsConfigured() const { return src_width_ > 0; }
+
+    static constexpr float kPadValue = 114.0f / 255.0f;
+
+private:
+    void RunRow(const uint8_t *row0, const uint8_t *row1, float wy0, float wy1,
+                float *dst_b, float *dst_g, float *dst_r) const;
+
+    int src_width_;
+    int src_height_;
+    int dst_width_;
+    int dst_height_;
+    int letterbox_width_;
+    int letterbox_height_;
+    int pad_left_;
+    int pad_top_;
+
+    // Per output column: byte offsets of the left/right source pixels and the right weight
+    AlignedBuffer<int32_t> x_offset0_;
+    AlignedBuffer<int32_t> x_offset1_;
+    AlignedBuffer<float> x_weight_;
+    // Columns before this index can read 4 bytes at x_offset1_ without leaving the row
+    int vector_cols_;
+
+    // Per output row: source rows and the vertical weights, pre-scaled by 1/255
+    AlignedBuffer<int32_t> y_row0_;
+    AlignedBuffer<int32_t> y_row1_;
+    AlignedBuffer<float> y_weight0_;
+    AlignedBuffer<float> y_weight1_;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Read-only memory mapping of a whole file.
+ *
+ * The mapping is shared, so every process mapping the same file reads the same page cache
+ * pages, and nothing is read from disk until a page is first touched. The file may be
+ * replaced (renamed over) while mapped; the mapping keeps the old contents.
+ */
+class MappedFile
+{
+public:
+    MappedFile() : data_(nullptr), size_(0) {}
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    /** @brief Map path, replacing any current mapping. False if it cannot be opened or is empty. */
+    bool Open(const std::string &path);
+    void Close();
+
+    /** @brief Hint that a byte range is read at random, so page faults in it do not read ahead. */
+    void AdviseRandom(size_t offset, size_t size) const;
+
+    const uint8_t *Data() const { return data_; }
+    size_t Size() const { return size_; }
+
+private:
+    const uint8_t *data_;
+    size_t size_;
+};
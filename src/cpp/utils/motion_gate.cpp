@@ -0,0 +1,94 @@
+#include "motion_gate.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+
+namespace {
+
+// Count the pixels differing by at least threshold and step the background one level towards current
+size_t DifferenceAndAdapt(const uint8_t *current, uint8_t *background, size_t count, uint8_t threshold)
+{
+    size_t changed = 0;
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    {
+        const __m256i one = _mm256_set1_epi8(1);
+        const __m256i vthreshold = _mm256_set1_epi8(static_cast<char>(threshold));
+        for (; i + 32 <= count; i += 32) {
+            __m256i cur = _mm256_load_si256(reinterpret_cast<const __m256i *>(current + i));
+            __m256i bg = _mm256_load_si256(reinterpret_cast<const __m256i *>(background + i));
+            __m256i brighter = _mm256_subs_epu8(cur, bg);
+            __m256i darker = _mm256_subs_epu8(bg, cur);
+            __m256i diff = _mm256_or_si256(brighter, darker);
+
+            // diff >= threshold  <=>  max(diff, threshold) == diff
+            __m256i is_changed = _mm256_cmpeq_epi8(_mm256_max_epu8(diff, vthreshold), diff);
+            changed += __builtin_popcount(static_cast<uint32_t>(_mm256_movemask_epi8(is_changed)));
+
+            bg = _mm256_subs_epu8(_mm256_adds_epu8(bg, _mm256_min_epu8(brighter, one)), _mm256_min_epu8(darker, one));
+            _mm256_store_si256(reinterpret_cast<__m256i *>(background + i), bg);
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        const int diff = static_cast<int>(current[i]) - background[i];
+        if (std::abs(diff) >= threshold) {
+            changed++;
+        }
+        background[i] += (diff > 0) - (diff < 0);
+    }
+    return changed;
+}
+
+} // namespace
+
+MotionGate::MotionGate(int width, int height, int pixel_threshold, float min_changed_fraction)
+    : width_(width), height_(height),
+      pixel_threshold_(static_cast<uint8_t>(std::min(std::max(pixel_threshold, 1), 255))),
+      initialized_(false), changed_fraction_(0.0f)
+{
+    const size_t num_pixels = static_cast<size_t>(width_) * height_;
+    min_changed_pixels_ = std::max<size_t>(1, static_cast<size_t>(min_changed_fraction * num_pixels));
+    current_.Resize(num_pixels);
+    background_.Resize(num_pixels);
+}
+
+bool MotionGate::Update(const uint8_t *rgb_data, int image_width, int image_height, size_t stride)
+{
+    Downscale(rgb_data, image_width, image_height, stride);
+
+    const size_t num_pixels = current_.size();
+    if (!initialized_) {
+        std::memcpy(background_.data(), current_.data(), num_pixels);
+        initialized_ = true;
+        changed_fraction_ = 1.0f;
+        return true;
+    }
+
+    size_t changed = DifferenceAndAdapt(current_.data(), background_.data(), num_pixels, pixel_threshold_);
+    changed_fraction_ = static_cast<float>(changed) / num_pixels;
+    return changed >= min_changed_pixels_;
+}
+
+void MotionGate::Downscale(const uint8_t *rgb_data, int image_width, int image_height, size_t stride)
+{
+    // Luma approximated as (R + 2G + B) / 4, averaged over a 2x2 block at every grid point
+    for (int y = 0; y < height_; y++) {
+        const int src_y = std::min((2 * y + 1) * image_height / (2 * height_), image_height - 2);
+        const uint8_t *row0 = rgb_data + static_cast<size_t>(src_y) * stride;
+        const uint8_t *row1 = row0 + stride;
+        uint8_t *dst = current_.data() + static_cast<size_t>(y) * width_;
+
+        for (int x = 0; x < width_; x++) {
+            const int src_x = std::min((2 * x + 1) * image_width / (2 * width_), image_width - 2) * 3;
+            int sum = 0;
+            for (const uint8_t *p : {row0 + src_x, row0 + src_x + 3, row1 + src_x, row1 + src_x + 3}) {
+                sum += p[0] + 2 * p[1] + p[2];
+            }
+            dst[x] = static_cast<uint8_t>(sum >> 4);
+        }
+    }
+}
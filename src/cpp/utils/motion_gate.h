@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include "aligned_buffer.h"
+
+/**
+ * @brief Cheap per-channel motion detector deciding whether a frame is worth running the detector on.
+ *
+ * Every frame is reduced to a tiny luma thumbnail (2x2-averaged samples on a fixed grid),
+ * which is differenced against an adaptive background 32 pixels per instruction. The
+ * background follows the scene by one grey level per frame towards the current thumbnail
+ * (an approximate running median), so lighting drifts and parked objects fade out while
+ * anything moving shows up as changed pixels.
+ */
+class MotionGate
+{
+public:
+    /**
+     * @param width, height         Thumbnail size.
+     * @param pixel_threshold       Min luma difference for a thumbnail pixel to count as changed.
+     * @param min_changed_fraction  Fraction of changed pixels that counts as motion.
+     */
+    explicit MotionGate(int width = 64, int height = 36, int pixel_threshold = 24, float min_changed_fraction = 0.003f);
+
+    /**
+     * @brief Compare an interleaved RGB frame with the background and update the background.
+     * @return true if the frame differs from the background; the first frame always does.
+     */
+    bool Update(const uint8_t *rgb_data, int image_width, int image_height, size_t stride);
+
+    /** @brief Fraction of thumbnail pixels that changed in the last Update(). */
+    float ChangedFraction() const { return changed_fraction_; }
+
+private:
+    void Downscale(const uint8_t *rgb_data, int image_width, int image_height, size_t stride);
+
+    int width_;
+    int height_;
+    uint8_t pixel_threshold_;
+    size_t min_changed_pixels_;
+    bool initialized_;
+    float changed_fraction_;
+
+    AlignedBuffer<uint8_t> current_;
+    AlignedBuffer<uint8_t> background_;
+};
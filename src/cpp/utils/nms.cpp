@@ -0,0 +1,199 @@
+#include "nms.h"
+#include <algorithm>
+#include <numeric>
+#include <immintrin.h>
+
+NmsEngine::NmsEngine(size_t max_candidates)
+    : max_candidates_(max_candidates)
+{
+}
+
+void NmsEngine::Reset()
+{
+    x_min_.clear();
+    y_min_.clear();
+    x_max_.clear();
+    y_max_.clear();
+    scores_.clear();
+    classes_.clear();
+    kept_.clear();
+}
+
+void NmsEngine::Add(float x_min, float y_min, float x_max, float y_max, float score, int32_t class_index)
+{
+    x_min_.push_back(x_min);
+    y_min_.push_back(y_min);
+    x_max_.push_back(x_max);
+    y_max_.push_back(y_max);
+    scores_.push_back(score);
+    classes_.push_back(class_index);
+}
+
+size_t NmsEngine::Run(float iou_threshold, bool class_aware, size_t max_outputs)
+{
+    kept_.clear();
+    size_t count = scores_.size();
+    if (count == 0) {
+        return 0;
+    }
+
+    // Top-K pre-selection, then rank the survivors; ties go to the earlier candidate
+    auto by_score = [this](int32_t a, int32_t b) {
+        return scores_[a] > scores_[b] || (scores_[a] == scores_[b] && a < b);
+    };
+    order_.resize(count);
+    std::iota(order_.begin(), order_.end(), 0);
+    if (max_candidates_ && count > max_candidates_) {
+        std::nth_element(order_.begin(), order_.begin() + max_candidates_, order_.end(), by_score);
+        count = max_candidates_;
+        order_.resize(count);
+    }
+    std::sort(order_.begin(), order_.end(), by_score);
+
+    // Batched NMS: give every class a disjoint x range wider than all boxes together
+    float class_offset = 0.0f;
+    if (class_aware) {
+        float lowest = x_min_[order_[0]], highest = x_max_[order_[0]];
+        for (int32_t id : order_) {
+            lowest = std::min(lowest, x_min_[id]);
+            highest = std::max(highest, x_max_[id]);
+        }
+        class_offset = highest - lowest + 1.0f;
+    }
+    auto shifted_x = [&](int32_t id) {
+        return class_aware ? x_min_[id] + classes_[id] * class_offset : x_min_[id];
+    };
+
+    sweep_order_.resize(count);
+    std::iota(sweep_order_.begin(), sweep_order_.end(), 0);
+    std::sort(sweep_order_.begin(), sweep_order_.end(), [&](int32_t a, int32_t b) {
+        return shifted_x(order_[a]) < shifted_x(order_[b]);
+    });
+
+    sweep_x1_.Resize(count);
+    sweep_y1_.Resize(count);
+    sweep_x2_.Resize(count);
+    sweep_y2_.Resize(count);
+    sweep_area_.Resize(count);
+    sweep_rank_.Resize(count);
+    position_of_rank_.resize(count);
+
+    float max_width = 0.0f;
+    for (size_t i = 0; i < count; i++) {
+        const int32_t rank = sweep_order_[i];
+        const int32_t id = order_[rank];
+        const float shift = shifted_x(id) - x_min_[id];
+        const float width = std::max(x_max_[id] - x_min_[id], 0.0f);
+        const float height = std::max(y_max_[id] - y_min_[id], 0.0f);
+
+        sweep_x1_[i] = x_min_[id] + shift;
+        sweep_y1_[i] = y_min_[id];
+        sweep_x2_[i] = x_max_[id] + shift;
+        sweep_y2_[i] = y_max_[id];
+        sweep_area_[i] = width * height;
+        sweep_rank_[i] = rank;
+        position_of_rank_[rank] = static_cast<int32_t>(i);
+        max_width = std::max(max_width, width);
+    }
+
+    const float *x1_begin = sweep_x1_.data();
+    const float *x1_end = sweep_x1_.data() + count;
+
+    for (size_t rank = 0; rank < count; rank++) {
+        const size_t box = position_of_rank_[rank];
+        if (sweep_rank_[box] < 0) {
+            continue;
+        }
+        kept_.push_back(order_[rank]);
+        if (max_outputs && kept_.size() == max_outputs) {
+            break;
+        }
+
+        // Only boxes starting within one max_width before this box and before its end can overlap it
+        const size_t begin = std::lower_bound(x1_begin, x1_end, sweep_x1_[box] - max_width) - x1_begin;
+        const size_t end = std::lower_bound(x1_begin, x1_end, sweep_x2_[box]) - x1_begin;
+        SuppressWindow(box, begin, end, static_cast<int32_t>(rank), iou_threshold);
+    }
+    return kept_.size();
+}
+
+void NmsEngine::SuppressWindow(size_t box, size_t begin, size_t end, int32_t rank, float iou_threshold)
+{
+    // iou > t  <=>  intersection * (1 + t) > t * (area_a + area_b), which avoids the division
+    const float x1 = sweep_x1_[box], y1 = sweep_y1_[box];
+    const float x2 = sweep_x2_[box], y2 = sweep_y2_[box];
+    const float area = sweep_area_[box];
+    const float inter_scale = 1.0f + iou_threshold;
+    size_t i = begin;
+
+#if defined(__AVX512F__)
+    {
+        const __m512 bx1 = _mm512_set1_ps(x1), by1 = _mm512_set1_ps(y1);
+        const __m512 bx2 = _mm512_set1_ps(x2), by2 = _mm512_set1_ps(y2);
+        const __m512 barea = _mm512_set1_ps(area);
+        const __m512 vscale = _mm512_set1_ps(inter_scale);
+        const __m512 vthreshold = _mm512_set1_ps(iou_threshold);
+        const __m512 zero = _mm512_setzero_ps();
+        const __m512i vrank = _mm512_set1_epi32(rank);
+        const __m512i suppressed = _mm512_set1_epi32(-1);
+
+        for (; i + 16 <= end; i += 16) {
+            __m512 iw = _mm512_sub_ps(_mm512_min_ps(bx2, _mm512_loadu_ps(sweep_x2_.data() + i)),
+                                      _mm512_max_ps(bx1, _mm512_loadu_ps(sweep_x1_.data() + i)));
+            __m512 ih = _mm512_sub_ps(_mm512_min_ps(by2, _mm512_loadu_ps(sweep_y2_.data() + i)),
+                                      _mm512_max_ps(by1, _mm512_loadu_ps(sweep_y1_.data() + i)));
+            __m512 inter = _mm512_mul_ps(_mm512_max_ps(iw, zero), _mm512_max_ps(ih, zero));
+            __m512 sum = _mm512_add_ps(barea, _mm512_loadu_ps(sweep_area_.data() + i));
+            __mmask16 overlap = _mm512_cmp_ps_mask(_mm512_mul_ps(inter, vscale),
+                                                   _mm512_mul_ps(sum, vthreshold), _CMP_GT_OQ);
+
+            __m512i ranks = _mm512_loadu_si512(sweep_rank_.data() + i);
+            __mmask16 later = _mm512_mask_cmpgt_epi32_mask(overlap, ranks, vrank);
+            _mm512_mask_storeu_epi32(sweep_rank_.data() + i, later, suppressed);
+        }
+    }
+#endif
+
+#if defined(__AVX2__)
+    {
+        const __m256 bx1 = _mm256_set1_ps(x1), by1 = _mm256_set1_ps(y1);
+        const __m256 bx2 = _mm256_set1_ps(x2), by2 = _mm256_set1_ps(y2);
+        const __m256 barea = _mm256_set1_ps(area);
+        const __m256 vscale = _mm256_set1_ps(inter_scale);
+        const __m256 vthreshold = _mm256_set1_ps(iou_threshold);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256i vrank = _mm256_set1_epi32(rank);
+
+        for (; i + 8 <= end; i += 8) {
+            __m256 iw = _mm256_sub_ps(_mm256_min_ps(bx2, _mm256_loadu_ps(sweep_x2_.data() + i)),
+                                      _mm256_max_ps(bx1, _mm256_loadu_ps(sweep_x1_.data() + i)));
+            __m256 ih = _mm256_sub_ps(_mm256_min_ps(by2, _mm256_loadu_ps(sweep_y2_.data() + i)),
+                                      _mm256_max_ps(by1, _mm256_loadu_ps(sweep_y1_.data() + i)));
+            __m256 inter = _mm256_mul_ps(_mm256_max_ps(iw, zero), _mm256_max_ps(ih, zero));
+            __m256 sum = _mm256_add_ps(barea, _mm256_loadu_ps(sweep_area_.data() + i));
+            __m256i overlap = _mm256_castps_si256(
+                _mm256_cmp_ps(_mm256_mul_ps(inter, vscale), _mm256_mul_ps(sum, vthreshold), _CMP_GT_OQ));
+
+            __m256i *rank_ptr = reinterpret_cast<__m256i *>(sweep_rank_.data() + i);
+            __m256i ranks = _mm256_loadu_si256(rank_ptr);
+            // Suppressed lanes become all ones, i.e. rank -1
+            __m256i later = _mm256_and_si256(overlap, _mm256_cmpgt_epi32(ranks, vrank));
+            _mm256_storeu_si256(rank_ptr, _mm256_or_si256(ranks, later));
+        }
+    }
+#endif
+
+    for (; i < end; i++) {
+        if (sweep_rank_[i] <= rank) {
+            continue;
+        }
+        const float iw = std::min(x2, sweep_x2_[i]) - std::max(x1, sweep_x1_[i]);
+        const float ih = std::min(y2, sweep_y2_[i]) - std::max(y1, sweep_y1_[i]);
+        if (iw <= 0.0f || ih <= 0.0f) {
+            continue;
+        }
+        if (iw * ih * inter_scale > (area + sweep_area_[i]) * iou_threshold) {
+            sweep_rank_[i] = -1;
+        }
+    }
+}
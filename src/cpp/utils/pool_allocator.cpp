@@ -0,0 +1,127 @@
+#include "pool_allocator.h"
+#include <cstdlib>
+
+namespace {
+
+// Every block starts with one alignment unit of bookkeeping so Release() only needs the pointer
+struct BlockHeader
+{
+    size_t class_index;
+    size_t block_bytes;
+    void *next_free; // next block of the size class's free list, while cached
+};
+
+void *AllocThunk(OrtAllocator *allocator, size_t size)
+{
+    return static_cast<PoolAllocator *>(allocator)->Allocate(size);
+}
+
+void FreeThunk(OrtAllocator *allocator, void *ptr)
+{
+    static_cast<PoolAllocator *>(allocator)->Release(ptr);
+}
+
+const OrtMemoryInfo *InfoThunk(const OrtAllocator *allocator)
+{
+    return static_cast<const PoolAllocator *>(allocator)->MemoryInfo();
+}
+
+} // namespace
+
+PoolAllocator::PoolAllocator()
+    : OrtAllocator{},
+      memory_info_("Cpu", OrtDeviceAllocator, 0, OrtMemTypeDefault),
+      num_system_allocations_(0),
+      bytes_in_use_(0)
+{
+    static_assert(sizeof(BlockHeader) <= kAlignment, "block header must fit in one alignment unit");
+
+    version = ORT_API_VERSION;
+    Alloc = AllocThunk;
+    Free = FreeThunk;
+    Info = InfoThunk;
+#if ORT_API_VERSION >= 18
+    Reserve = AllocThunk;
+#endif
+}
+
+PoolAllocator::~PoolAllocator()
+{
+    for (auto& size_class : classes_) {
+        while (void *block = size_class.free_list) {
+            size_class.free_list = static_cast<BlockHeader *>(block)->next_free;
+            std::free(block);
+        }
+    }
+}
+
+size_t PoolAllocator::ClassIndex(size_t size)
+{
+    size_t shift = kMinClassShift;
+    while (shift <= kMaxClassShift && (size_t(1) << shift) < size) {
+        shift++;
+    }
+    return shift - kMinClassShift;
+}
+
+void *PoolAllocator::Allocate(size_t size)
+{
+    size_t class_index = ClassIndex(size);
+    size_t block_bytes = (class_index < kNumClasses)
+                             ? (size_t(1) << (class_index + kMinClassShift))
+                             : (size + kAlignment - 1) / kAlignment * kAlignment;
+
+    void *block = nullptr;
+    if (class_index < kNumClasses) {
+        SizeClass &size_class = classes_[class_index];
+        std::lock_guard<std::mutex> lock(size_class.mutex);
+        if (size_class.free_list) {
+            block = size_class.free_list;
+            size_class.free_list = static_cast<BlockHeader *>(block)->next_free;
+            size_class.retained_bytes -= block_bytes;
+        }
+    }
+
+    if (!block) {
+        block = std::aligned_alloc(kAlignment, block_bytes + kAlignment);
+        if (!block) {
+            // Reported to ORT as an allocation failure, never thrown across the C API
+            return nullptr;
+        }
+        num_system_allocations_.fetch_add(1, std::memory_order_relaxed);
+        BlockHeader *header = static_cast<BlockHeader *>(block);
+        header->class_index = class_index;
+        header->block_bytes = block_bytes;
+    }
+
+    bytes_in_use_.fetch_add(block_bytes, std::memory_order_relaxed);
+    return static_cast<char *>(block) + kAlignment;
+}
+
+void PoolAllocator::Release(void *ptr)
+{
+    if (!ptr) {
+        return;
+    }
+
+    void *block = static_cast<char *>(ptr) - kAlignment;
+    BlockHeader *header = static_cast<BlockHeader *>(block);
+    bytes_in_use_.fetch_sub(header->block_bytes, std::memory_order_relaxed);
+
+    if (header->class_index >= kNumClasses) {
+        std::free(block);
+        return;
+    }
+
+    SizeClass &size_class = classes_[header->class_index];
+    {
+        std::lock_guard<std::mutex> lock(size_class.mutex);
+        if (!size_class.free_list || size_class.retained_bytes + header->block_bytes <= kMaxRetainedBytes) {
+            header->next_free = size_class.free_list;
+            size_class.free_list = block;
+            size_class.retained_bytes += header->block_bytes;
+            return;
+        }
+    }
+    std::free(block);
+}
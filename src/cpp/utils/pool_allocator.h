@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <onnxruntime_cxx_api.h>
+
+/**
+ * @brief OrtAllocator backed by per-size-class free lists of 64-byte aligned blocks.
+ *
+ * Registered on the shared Ort::Env so every session allocates its intermediate
+ * tensors from here. Freed blocks are kept for reuse instead of going back to
+ * malloc, so once every size class has been touched a steady-state frame does not
+ * reach the system allocator at all. The free lists are linked through the block
+ * headers, so releasing a block never allocates, and each size class keeps at most
+ * kMaxRetainedBytes (or one block, if larger): the rest of a one-off peak, such as
+ * an unusually large batch, goes back to the system.
+ */
+class PoolAllocator : public OrtAllocator
+{
+public:
+    PoolAllocator();
+    ~PoolAllocator();
+
+    PoolAllocator(const PoolAllocator &) = delete;
+    PoolAllocator &operator=(const PoolAllocator &) = delete;
+
+    void *Allocate(size_t size);
+    void Release(void *ptr);
+
+    /** @brief Number of blocks obtained from the system allocator so far. */
+    uint64_t NumSystemAllocations() const { return num_system_allocations_.load(std::memory_order_relaxed); }
+    /** @brief Bytes currently handed out to ORT. */
+    uint64_t BytesInUse() const { return bytes_in_use_.load(std::memory_order_relaxed); }
+
+    const OrtMemoryInfo *MemoryInfo() const { return memory_info_; }
+
+private:
+    static constexpr size_t kAlignment = 64;
+    static constexpr size_t kMinClassShift = 6;  // 64 B
+    static constexpr size_t kMaxClassShift = 30; // 1 GiB, larger blocks bypass the pool
+    static constexpr size_t kNumClasses = kMaxClassShift - kMinClassShift + 1;
+    static constexpr size_t kMaxRetainedBytes = size_t(64) << 20; // cached per size class
+
+    struct SizeClass
+    {
+        std::mutex mutex;
+        void *free_list = nullptr; // blocks linked through their headers
+        size_t retained_bytes = 0;
+    };
+
+    static size_t ClassIndex(size_t size);
+
+    Ort::MemoryInfo memory_info_;
+    SizeClass classes_[kNumClasses];
+    std::atomic<uint64_t> num_system_allocations_;
+    std::atomic<uint64_t> bytes_in_use_;
+};
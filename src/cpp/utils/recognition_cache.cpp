@@ -0,0 +1,104 @@
+#include "recognition_cache.h"
+#include <algorithm>
+#include <cmath>
+
+RecognitionCache::RecognitionCache(float quality_gain, float ambiguous_margin, int retry_frames, int max_idle_frames)
+    : quality_gain_(quality_gain), ambiguous_margin_(ambiguous_margin), retry_frames_(retry_frames),
+      max_idle_frames_(max_idle_frames), frame_(0)
+{
+}
+
+void RecognitionCache::NextFrame()
+{
+    frame_++;
+    entries_.erase(std::remove_if(entries_.begin(), entries_.end(),
+                                  [this](const Entry &entry) { return frame_ - entry.last_seen_frame > max_idle_frames_; }),
+                   entries_.end());
+}
+
+int RecognitionCache::Identity(int track_id)
+{
+    Entry *entry = Find(track_id);
+    if (!entry) {
+        return -1;
+    }
+    entry->last_seen_frame = frame_;
+    return entry->match.identity_id;
+}
+
+bool RecognitionCache::NeedsEmbedding(int track_id, float quality) const
+{
+    const Entry *entry = Find(track_id);
+    if (!entry) {
+        return true;
+    }
+    if (quality > entry->quality * (1.0f + quality_gain_)) {
+        return true;
+    }
+    return entry->match.margin < ambiguous_margin_ && frame_ - entry->last_embedded_frame >= retry_frames_;
+}
+
+const float *RecognitionCache::AddEmbedding(int track_id, const float *embedding, size_t size, float quality)
+{
+    Entry *entry = Find(track_id);
+    if (!entry) {
+        entries_.push_back(Entry{track_id, std::vector<float>(embedding, embedding + size), quality,
+                                 FaceMatch(), frame_, frame_, -1});
+        return entries_.back().embedding.data();
+    }
+
+    entry->last_embedded_frame = frame_;
+    entry->last_seen_frame = frame_;
+    if (quality >= entry->quality || entry->embedding.size() != size) {
+        entry->embedding.assign(embedding, embedding + size);
+        entry->quality = quality;
+        return entry->embedding.data();
+    }
+
+    // Ambiguous retry with a weaker view: average the two views by quality and renormalize
+    const float total = entry->quality + quality;
+    const float w_cached = total > 0.0f ? entry->quality / total : 0.5f;
+    const float w_fresh = 1.0f - w_cached;
+    float norm = 0.0f;
+    for (size_t d = 0; d < size; d++) {
+        entry->embedding[d] = w_cached * entry->embedding[d] + w_fresh * embedding[d];
+        norm += entry->embedding[d] * entry->embedding[d];
+    }
+    const float scale = norm > 0.0f ? 1.0f / std::sqrt(norm) : 0.0f;
+    for (size_t d = 0; d < size; d++) {
+        entry->embedding[d] *= scale;
+    }
+    return entry->embedding.data();
+}
+
+void RecognitionCache::SetMatch(int track_id, const FaceMatch &match, bool full_gallery)
+{
+    Entry *entry = Find(track_id);
+    if (entry) {
+        entry->match = match;
+        if (full_gallery) {
+            entry->last_full_search_frame = frame_;
+        }
+    }
+}
+
+bool RecognitionCache::FullSearchDue(int track_id, int interval) const
+{
+    const Entry *entry = Find(track_id);
+    return !entry || entry->last_full_search_frame < 0 || frame_ - entry->last_full_search_frame >= interval;
+}
+
+RecognitionCache::Entry *RecognitionCache::Find(int track_id)
+{
+    for (Entry &entry : entries_) {
+        if (entry.track_id == track_id) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+const RecognitionCache::Entry *RecognitionCache::Find(int track_id) const
+{
+    return const_cast<RecognitionCache *>(this)->Find(track_id);
+}
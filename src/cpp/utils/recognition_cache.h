@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "face_core.h"
+
+/**
+ * @brief Per-channel recognition results keyed by track ID.
+ *
+ * Each tracked face keeps the best embedding seen so far, weighted by its face quality,
+ * and the identity and match margin found for it. The embedding model is run again for a
+ * track only when a clearly better view of the face shows up, or, at a bounded rate,
+ * while its match is ambiguous; every other frame reuses the cached identity, so gallery
+ * searches happen per track instead of per frame. Matches found on the watchlist tier alone
+ * are told apart, so the full gallery can be searched for a track at a bounded rate.
+ *
+ * Not thread-safe; owned by the channel's recognition stage.
+ */
+class RecognitionCache
+{
+public:
+    /**
+     * @param quality_gain      Relative quality improvement that triggers a re-embedding.
+     * @param ambiguous_margin  Matches with a smaller margin are retried.
+     * @param retry_frames      Min frames between retries of an ambiguous match.
+     * @param max_idle_frames   Entries of tracks unseen for longer are dropped.
+     */
+    explicit RecognitionCache(float quality_gain = 0.25f, float ambiguous_margin = 0.1f,
+                              int retry_frames = 15, int max_idle_frames = 60);
+
+    /** @brief Advance to the next frame and drop the entries of tracks that have gone. */
+    void NextFrame();
+
+    /** @brief Cached identity of a track, -1 if unknown; marks the track as seen this frame. */
+    int Identity(int track_id);
+
+    /** @brief Whether a face of this track with the given quality is worth embedding. */
+    bool NeedsEmbedding(int track_id, float quality) const;
+
+    /**
+     * @brief Merge a fresh L2-normalized embedding into the track's entry.
+     * A better quality view replaces the cached embedding; a retry of an ambiguous match is
+     * blended in by quality. @return The track's embedding to match against the gallery.
+     */
+    const float *AddEmbedding(int track_id, const float *embedding, size_t size, float quality);
+
+    /**
+     * @brief Store the gallery match of the embedding returned by AddEmbedding().
+     * @param full_gallery  Whether the match comes from the full gallery or the watchlist tier only.
+     */
+    void SetMatch(int track_id, const FaceMatch &match, bool full_gallery = true);
+
+    /** @brief Whether the track has not been matched against the full gallery in the last interval frames. */
+    bool FullSearchDue(int track_id, int interval) const;
+
+    size_t Size() const { return entries_.size(); }
+
+private:
+    struct Entry
+    {
+        int track_id;
+        std::vector<float> embedding; // best (or blended) view so far
+        float quality;
+        FaceMatch match;
+        long last_embedded_frame;
+        long last_seen_frame;
+        long last_full_search_frame; // -1 until matched against the full gallery
+    };
+
+    Entry *Find(int track_id);
+    const Entry *Find(int track_id) const;
+
+    float quality_gain_;
+    float ambiguous_margin_;
+    int retry_frames_;
+    int max_idle_frames_;
+    long frame_;
+
+    std::vector<Entry> entries_;
+};
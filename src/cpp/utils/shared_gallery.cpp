@@ -0,0 +1,157 @@
+#include "shared_gallery.h"
+#include <stdexcept>
+
+namespace {
+
+constexpr size_t kMaxReaderThreads = 256;
+
+} // namespace
+
+// Epoch a reading thread is in, 0 while it reads nothing; one cache line per thread
+struct alignas(64) SharedGallery::ReaderSlot
+{
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> claimed{false};
+    uint32_t depth = 0; // nested guards of the owning thread
+};
+
+struct SharedGallery::SlotTable
+{
+    ReaderSlot slots[kMaxReaderThreads];
+};
+
+SharedGallery::Snapshot::Snapshot(const SharedGallery &gallery) : gallery_(gallery), slot_(gallery.ThreadSlot())
+{
+    // Announce the epoch before loading the pointer: a snapshot retired after this load is
+    // retired with a later epoch, and is not freed while the slot holds this one
+    if (slot_->depth++ == 0) {
+        slot_->epoch.store(gallery.epoch_.load());
+    }
+    database_ = gallery.current_.load();
+}
+
+SharedGallery::Snapshot::~Snapshot()
+{
+    if (--slot_->depth == 0) {
+        slot_->epoch.store(0, std::memory_order_release);
+        // A snapshot retired while this thread read it may be waiting for this release
+        if (gallery_.num_retired_.load(std::memory_order_relaxed) > 0) {
+            gallery_.TryReclaim();
+        }
+    }
+}
+
+SharedGallery::SharedGallery()
+    : slots_(std::make_shared<SlotTable>()), current_(new FaceDatabase()), epoch_(1), num_retired_(0)
+{
+}
+
+SharedGallery::~SharedGallery()
+{
+    delete current_.load();
+    for (auto &retired : retired_) {
+        delete retired.second;
+    }
+}
+
+SharedGallery::ReaderSlot *SharedGallery::ThreadSlot() const
+{
+    // Slots claimed by this thread, released when it exits
+    struct ThreadSlots
+    {
+        std::vector<std::pair<std::shared_ptr<SlotTable>, ReaderSlot *>> claimed;
+        ~ThreadSlots()
+        {
+            for (auto &entry : claimed) {
+                entry.second->claimed.store(false, std::memory_order_release);
+            }
+        }
+    };
+    thread_local ThreadSlots thread_slots;
+    for (auto &entry : thread_slots.claimed) {
+        if (entry.first == slots_) {
+            return entry.second;
+        }
+    }
+
+    for (ReaderSlot &slot : slots_->slots) {
+        bool expected = false;
+        if (slot.claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            slot.depth = 0;
+            thread_slots.claimed.emplace_back(slots_, &slot);
+            return &slot;
+        }
+    }
+    throw std::runtime_error("SharedGallery: more than 256 reader threads");
+}
+
+void SharedGallery::Update(const std::function<void(FaceDatabase &)> &edit)
+{
+    std::lock_guard<std::mutex> lock(writer_mutex_);
+    auto next = std::make_unique<FaceDatabase>(*current_.load());
+    edit(*next);
+
+    // Readers entering from here on announce the new epoch and load the new snapshot
+    const FaceDatabase *previous = current_.exchange(next.release());
+    retired_.emplace_back(epoch_.fetch_add(1) + 1, previous);
+    Reclaim();
+}
+
+void SharedGallery::TryReclaim() const
+{
+    std::unique_lock<std::mutex> lock(writer_mutex_, std::try_to_lock);
+    if (lock.owns_lock()) {
+        Reclaim();
+    }
+}
+
+void SharedGallery::Reclaim() const
+{
+    uint64_t oldest = UINT64_MAX;
+    for (const ReaderSlot &slot : slots_->slots) {
+        const uint64_t epoch = slot.epoch.load();
+        if (epoch != 0 && epoch < oldest) {
+            oldest = epoch;
+        }
+    }
+    size_t kept = 0;
+    for (auto &retired : retired_) {
+        if (retired.first <= oldest) {
+            delete retired.second;
+        }
+        else {
+            retired_[kept++] = retired;
+        }
+    }
+    retired_.resize(kept);
+    num_retired_.store(kept, std::memory_order_relaxed);
+}
+
+bool SharedGallery::Open(const std::string &path)
+{
+    bool opened = false;
+    Update([&](FaceDatabase &database) { opened = database.open(path); });
+    return opened;
+}
+
+int SharedGallery::AddIdentity(const std::string &name)
+{
+    int id = -1;
+    Update([&](FaceDatabase &database) { id = database.add_identity(name); });
+    return id;
+}
+
+void SharedGallery::AddEmbeddingToIdentity(int id, const std::vector<float> &embedding)
+{
+    Update([&](FaceDatabase &database) { database.add_embedding_to_identity(id, embedding); });
+}
+
+void SharedGallery::SetIdentityThreshold(int id, float threshold)
+{
+    Update([&](FaceDatabase &database) { database.set_identity_threshold(id, threshold); });
+}
+
+void SharedGallery::SetWatchlist(int id, bool watchlist)
+{
+    Update([&](FaceDatabase &database) { database.set_watchlist(id, watchlist); });
+}
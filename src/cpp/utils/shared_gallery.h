@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "face_database.h"
+
+/**
+ * @brief One face database shared by every channel, read through immutable snapshots.
+ *
+ * Readers pin the current snapshot with a Snapshot guard: a store of the global epoch into a
+ * per-thread slot and a load of the snapshot pointer, with no lock and no shared counter
+ * written, so recognition threads never wait for each other or for enrollment. Writers edit
+ * a copy of the current gallery under a writer mutex and publish it with one pointer swap;
+ * the replaced snapshot is retired with the new epoch and freed once no slot is still in an
+ * older epoch (epoch-based reclamation). The check runs on every publish and whenever a reader
+ * releases its last guard while snapshots are retired, skipped only if a writer holds the
+ * mutex then, so memory is one gallery plus the snapshots still being read, whatever the
+ * number of channels, without waiting for the next enrollment.
+ *
+ * Publishing copies the gallery, so enrollments should be grouped into one Update().
+ */
+class SharedGallery
+{
+    struct ReaderSlot;
+    struct SlotTable;
+
+public:
+    /** @brief Pins the snapshot current at construction for the lifetime of the guard. */
+    class Snapshot
+    {
+    public:
+        explicit Snapshot(const SharedGallery &gallery);
+        ~Snapshot();
+
+        Snapshot(const Snapshot &) = delete;
+        Snapshot &operator=(const Snapshot &) = delete;
+
+        const FaceDatabase &operator*() const { return *database_; }
+        const FaceDatabase *operator->() const { return database_; }
+
+    private:
+        const SharedGallery &gallery_;
+        ReaderSlot *slot_;
+        const FaceDatabase *database_;
+    };
+
+    SharedGallery();
+    ~SharedGallery();
+
+    SharedGallery(const SharedGallery &) = delete;
+    SharedGallery &operator=(const SharedGallery &) = delete;
+
+    /**
+     * @brief Apply edit to a copy of the current gallery and publish the copy. Writers are
+     * serialized; readers keep the snapshot they hold and pick up the new one on their next read.
+     */
+    void Update(const std::function<void(FaceDatabase &)> &edit);
+
+    /** @brief Replace the gallery with a gallery file, see FaceDatabase::open(). */
+    bool Open(const std::string &path);
+
+    /** @brief Enroll an identity and publish it. @return Its ID. */
+    int AddIdentity(const std::string &name);
+
+    /** @brief Enroll a template and publish it. */
+    void AddEmbeddingToIdentity(int id, const std::vector<float> &embedding);
+
+    /** @brief Give an identity its own match threshold and publish it. */
+    void SetIdentityThreshold(int id, float threshold);
+
+    /** @brief Add an identity to the watchlist tier, or remove it, and publish it. */
+    void SetWatchlist(int id, bool watchlist);
+
+    /** @brief Number of snapshots published so far. */
+    uint64_t Version() const { return epoch_.load(std::memory_order_relaxed) - 1; }
+
+private:
+    ReaderSlot *ThreadSlot() const;
+
+    // Free the retired snapshots no reader can still hold; writer mutex held
+    void Reclaim() const;
+
+    // Reclaim for a reader that released its last guard, unless a writer holds the mutex
+    void TryReclaim() const;
+
+    std::shared_ptr<SlotTable> slots_; // also held by the threads that claimed a slot
+    std::atomic<const FaceDatabase *> current_;
+    std::atomic<uint64_t> epoch_; // starts at 1; 0 marks an idle slot
+
+    // Mutable so that readers, which only see a const gallery, can free retired snapshots
+    mutable std::mutex writer_mutex_;
+    mutable std::vector<std::pair<uint64_t, const FaceDatabase *>> retired_; // epoch of retirement, snapshot
+    mutable std::atomic<size_t> num_retired_; // size of retired_, read by readers without the mutex
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+
+// Rows scored per pass of the query by the gallery scans
+constexpr size_t kDotRowBlock = 4;
+
+/**
+ * @brief Dot products of a query with R consecutive rows of a row-major matrix.
+ *
+ * Rows start 64-byte aligned, stride floats apart, and are zero-padded past size to a
+ * multiple of 16 floats, so only the query tail needs masking. Scoring several rows per
+ * pass of the query keeps R independent FMA chains in flight.
+ */
+template <size_t R>
+inline void DotRows(const float *query, size_t size, const float *rows, size_t stride, float *out)
+{
+    size_t d = 0;
+#if defined(__AVX512F__)
+    __m512 acc[R];
+    for (size_t r = 0; r < R; r++) {
+        acc[r] = _mm512_setzero_ps();
+    }
+    for (; d + 16 <= size; d += 16) {
+        const __m512 q = _mm512_loadu_ps(query + d);
+        for (size_t r = 0; r < R; r++) {
+            acc[r] = _mm512_fmadd_ps(_mm512_load_ps(rows + r * stride + d), q, acc[r]);
+        }
+    }
+    if (d < size) {
+        // The padding of the rows is zero, so only the query needs masking
+        const __m512 q = _mm512_maskz_loadu_ps(static_cast<__mmask16>((1u << (size - d)) - 1), query + d);
+        for (size_t r = 0; r < R; r++) {
+            acc[r] = _mm512_fmadd_ps(_mm512_load_ps(rows + r * stride + d), q, acc[r]);
+        }
+        d = size;
+    }
+    for (size_t r = 0; r < R; r++) {
+        out[r] = _mm512_reduce_add_ps(acc[r]);
+    }
+#elif defined(__AVX2__)
+    __m256 acc[R];
+    for (size_t r = 0; r < R; r++) {
+        acc[r] = _mm256_setzero_ps();
+    }
+    for (; d + 8 <= size; d += 8) {
+        const __m256 q = _mm256_loadu_ps(query + d);
+        for (size_t r = 0; r < R; r++) {
+            acc[r] = _mm256_fmadd_ps(_mm256_load_ps(rows + r * stride + d), q, acc[r]);
+        }
+    }
+    for (size_t r = 0; r < R; r++) {
+        const __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(acc[r]), _mm256_extractf128_ps(acc[r], 1));
+        const __m128 sum2 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+        out[r] = _mm_cvtss_f32(_mm_add_ss(sum2, _mm_movehdup_ps(sum2)));
+    }
+#else
+    for (size_t r = 0; r < R; r++) {
+        out[r] = 0.0f;
+    }
+#endif
+    for (; d < size; d++) {
+        for (size_t r = 0; r < R; r++) {
+            out[r] += rows[r * stride + d] * query[d];
+        }
+    }
+}
+
+/**
+ * @brief Exact int32 dot products of an int8 query with R consecutive int8 rows.
+ *
+ * Query and rows hold values in [-127, 127] and are zero-padded to stride, a multiple of
+ * 64 bytes. The sign of each query byte is moved onto the row byte so the unsigned x signed
+ * multiply-adds apply: VNNI (vpdpbusd) takes 64 bytes per instruction, AVX2 pairs
+ * vpmaddubsw, which cannot saturate within that range, with vpmaddwd.
+ */
+template <size_t R>
+inline void DotRowsInt8(const int8_t *query, const int8_t *rows, size_t stride, int32_t *out)
+{
+    size_t d = 0;
+#if defined(__AVX512VNNI__) && defined(__AVX512BW__)
+    __m512i acc[R];
+    for (size_t r = 0; r < R; r++) {
+        acc[r] = _mm512_setzero_si512();
+    }
+    for (; d < stride; d += 64) {
+        const __m512i q = _mm512_loadu_si512(query + d);
+        const __m512i q_abs = _mm512_abs_epi8(q);
+        const __mmask64 negative = _mm512_movepi8_mask(q);
+        for (size_t r = 0; r < R; r++) {
+            const __m512i row = _mm512_load_si512(rows + r * stride + d);
+            const __m512i row_signed = _mm512_mask_sub_epi8(row, negative, _mm512_setzero_si512(), row);
+            acc[r] = _mm512_dpbusd_epi32(acc[r], q_abs, row_signed);
+        }
+    }
+    for (size_t r = 0; r < R; r++) {
+        out[r] = _mm512_reduce_add_epi32(acc[r]);
+    }
+#elif defined(__AVX2__)
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i acc[R];
+    for (size_t r = 0; r < R; r++) {
+        acc[r] = _mm256_setzero_si256();
+    }
+    for (; d < stride; d += 32) {
+        const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(query + d));
+        const __m256i q_abs = _mm256_abs_epi8(q);
+        for (size_t r = 0; r < R; r++) {
+            const __m256i row = _mm256_load_si256(reinterpret_cast<const __m256i *>(rows + r * stride + d));
+            const __m256i pairs = _mm256_maddubs_epi16(q_abs, _mm256_sign_epi8(row, q));
+            acc[r] = _mm256_add_epi32(acc[r], _mm256_madd_epi16(pairs, ones));
+        }
+    }
+    for (size_t r = 0; r < R; r++) {
+        const __m128i sum4 = _mm_add_epi32(_mm256_castsi256_si128(acc[r]), _mm256_extracti128_si256(acc[r], 1));
+        const __m128i sum2 = _mm_add_epi32(sum4, _mm_unpackhi_epi64(sum4, sum4));
+        out[r] = _mm_cvtsi128_si32(_mm_add_epi32(sum2, _mm_shuffle_epi32(sum2, 1)));
+    }
+#else
+    for (size_t r = 0; r < R; r++) {
+        out[r] = 0;
+    }
+#endif
+    for (; d < stride; d++) {
+        for (size_t r = 0; r < R; r++) {
+            out[r] += static_cast<int32_t>(rows[r * stride + d]) * query[d];
+        }
+    }
+}
+
+// Queries scored per pass over the rows by the batched scan, as many as the registers hold
+#if defined(__AVX512F__)
+constexpr size_t kDotQueryBlock = 4;
+#else
+constexpr size_t kDotQueryBlock = 2;
+#endif
+
+#if defined(__AVX2__)
+// Horizontal sums of four vectors as one: {sum(a), sum(b), sum(c), sum(d)}
+inline __m128 Sum4(__m256 a, __m256 b, __m256 c, __m256 d)
+{
+    const __m256 sums = _mm256_hadd_ps(_mm256_hadd_ps(a, b), _mm256_hadd_ps(c, d));
+    return _mm_add_ps(_mm256_castps256_ps128(sums), _mm256_extractf128_ps(sums, 1));
+}
+#endif
+
+#if defined(__AVX512F__)
+inline __m256 FoldToYmm(__m512 v)
+{
+    return _mm256_add_ps(_mm512_castps512_ps256(v),
+                         _mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(v), 1)));
+}
+#endif
+
+/**
+ * @brief Q x R block of dot products between queries and rows, both zero-padded to stride.
+ *
+ * The register-blocked micro-kernel of the batched gallery scan: every row vector loaded
+ * is used by Q queries and every query vector by R rows, so one pass over a tile of rows
+ * serves a whole batch of faces. out[q * out_stride + r] receives query q . row r.
+ */
+template <size_t Q, size_t R>
+inline void DotBlock(const float *queries, const float *rows, size_t stride, float *out, size_t out_stride)
+{
+#if defined(__AVX512F__)
+    __m512 acc[Q][R];
+    for (size_t q = 0; q < Q; q++) {
+        for (size_t r = 0; r < R; r++) {
+            acc[q][r] = _mm512_setzero_ps();
+        }
+    }
+    for (size_t d = 0; d < stride; d += 16) {
+        __m512 row[R];
+        for (size_t r = 0; r < R; r++) {
+            row[r] = _mm512_load_ps(rows + r * stride + d);
+        }
+        for (size_t q = 0; q < Q; q++) {
+            const __m512 query = _mm512_load_ps(queries + q * stride + d);
+            for (size_t r = 0; r < R; r++) {
+                acc[q][r] = _mm512_fmadd_ps(query, row[r], acc[q][r]);
+            }
+        }
+    }
+    for (size_t q = 0; q < Q; q++) {
+        size_t r = 0;
+        for (; r + 4 <= R; r += 4) {
+            _mm_storeu_ps(out + q * out_stride + r,
+                          Sum4(FoldToYmm(acc[q][r]), FoldToYmm(acc[q][r + 1]), FoldToYmm(acc[q][r + 2]),
+                               FoldToYmm(acc[q][r + 3])));
+        }
+        for (; r < R; r++) {
+            out[q * out_stride + r] = _mm512_reduce_add_ps(acc[q][r]);
+        }
+    }
+#elif defined(__AVX2__)
+    __m256 acc[Q][R];
+    for (size_t q = 0; q < Q; q++) {
+        for (size_t r = 0; r < R; r++) {
+            acc[q][r] = _mm256_setzero_ps();
+        }
+    }
+    for (size_t d = 0; d < stride; d += 8) {
+        __m256 row[R];
+        for (size_t r = 0; r < R; r++) {
+            row[r] = _mm256_load_ps(rows + r * stride + d);
+        }
+        for (size_t q = 0; q < Q; q++) {
+            const __m256 query = _mm256_load_ps(queries + q * stride + d);
+            for (size_t r = 0; r < R; r++) {
+                acc[q][r] = _mm256_fmadd_ps(query, row[r], acc[q][r]);
+            }
+        }
+    }
+    for (size_t q = 0; q < Q; q++) {
+        size_t r = 0;
+        for (; r + 4 <= R; r += 4) {
+            _mm_storeu_ps(out + q * out_stride + r, Sum4(acc[q][r], acc[q][r + 1], acc[q][r + 2], acc[q][r + 3]));
+        }
+        for (; r < R; r++) {
+            const __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(acc[q][r]), _mm256_extractf128_ps(acc[q][r], 1));
+            const __m128 sum2 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+            out[q * out_stride + r] = _mm_cvtss_f32(_mm_add_ss(sum2, _mm_movehdup_ps(sum2)));
+        }
+    }
+#else
+    for (size_t q = 0; q < Q; q++) {
+        for (size_t r = 0; r < R; r++) {
+            float sum = 0.0f;
+            for (size_t d = 0; d < stride; d++) {
+                sum += queries[q * stride + d] * rows[r * stride + d];
+            }
+            out[q * out_stride + r] = sum;
+        }
+    }
+#endif
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <immintrin.h>
+
+/**
+ * @brief Write the indices of all values >= threshold to indices, in ascending order.
+ *
+ * Compares 16 (AVX-512) or 8 (AVX2) values per instruction and compresses the matching
+ * lanes into the index list, so a detector output with a handful of candidates among
+ * thousands of anchors costs little more than streaming the scores once.
+ *
+ * @param indices  Room for count entries.
+ * @return Number of indices written.
+ */
+inline size_t ScanThreshold(const float *values, int32_t count, float threshold, int32_t *indices)
+{
+    size_t num_indices = 0;
+    int32_t i = 0;
+
+#if defined(__AVX512F__)
+    {
+        const __m512 vthreshold = _mm512_set1_ps(threshold);
+        const __m512i step = _mm512_set1_epi32(16);
+        __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        for (; i + 16 <= count; i += 16) {
+            __mmask16 mask = _mm512_cmp_ps_mask(_mm512_loadu_ps(values + i), vthreshold, _CMP_GE_OQ);
+            if (mask) {
+                _mm512_mask_compressstoreu_epi32(indices + num_indices, mask, lanes);
+                num_indices += __builtin_popcount(mask);
+            }
+            lanes = _mm512_add_epi32(lanes, step);
+        }
+    }
+#endif
+
+#if defined(__AVX2__)
+    {
+        const __m256 vthreshold = _mm256_set1_ps(threshold);
+        for (; i + 8 <= count; i += 8) {
+            int mask = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(values + i), vthreshold, _CMP_GE_OQ));
+            while (mask) {
+                indices[num_indices++] = i + __builtin_ctz(mask);
+                mask &= mask - 1;
+            }
+        }
+    }
+#endif
+
+    for (; i < count; i++) {
+        if (values[i] >= threshold) {
+            indices[num_indices++] = i;
+        }
+    }
+    return num_indices;
+}
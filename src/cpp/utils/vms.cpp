@@ -8,6 +8,27 @@ void ReadVmsConfigFromFile(const char *cfg_path, VmsCfg &config)
     config.num_chs = 16;
     config.inf_confidence = 0.3;
     config.inf_iou = 0.45;
+    config.inf_threads = 0;
+    config.inf_sessions = 2;
+    config.inf_batch_size = 1;
+    config.inf_batch_timeout_ms = 5.0f;
+    config.inf_precision = "fp32";
+    config.inf_decode = "post";
+    config.inf_async = 0;
+    config.ort_cache = 1;
+    config.fr_threshold = 0.6f;
+    config.fr_min_quality = 0.1f;
+    config.fr_index = 0;
+    config.fr_index_m = 16;
+    config.fr_index_ef = 64;
+    config.fr_int8 = 0;
+    config.track = 0;
+    config.track_interval = 3;
+    config.fr_cold_interval = 15;
+    config.motion_gate = 0;
+    config.motion_heartbeat = 30;
+    config.motion_threshold = 24;
+    config.ort_cache_dir = "models/ort_cache";
     config.screen_idx = 0;
     printf("reading config = %s\n", cfg_path);
     infile.open(cfg_path);
@@ -67,6 +88,82 @@ void ReadVmsConfigFromFile(const char *cfg_path, VmsCfg &config)
                 config.dfp_file = value;
                 printf("(VMS config) dfp = %s\n", value.c_str());
             }
+            else if (param == string("dfp_int8"))
+            {
+                config.dfp_int8_file = value;
+                printf("(VMS config) int8 dfp = %s\n", value.c_str());
+            }
+            else if (param == string("dfp_raw"))
+            {
+                config.dfp_raw_file = value;
+                printf("(VMS config) raw-head dfp = %s\n", value.c_str());
+            }
+            else if (param == string("inf_decode"))
+            {
+                config.inf_decode = value;
+                printf("(VMS config) detector decode = %s\n", config.inf_decode.c_str());
+                if (config.inf_decode != "post" && config.inf_decode != "raw")
+                {
+                    printf("(VMS config) unknown inf_decode, using post\n");
+                    config.inf_decode = "post";
+                }
+            }
+            else if (param == string("facenet"))
+            {
+                config.facenet_file = value;
+                printf("(VMS config) face embedding model = %s\n", config.facenet_file.c_str());
+            }
+            else if (param == string("fr_threshold"))
+            {
+                config.fr_threshold = stof(value);
+                printf("(VMS config) face match threshold = %.2f\n", config.fr_threshold);
+            }
+            else if (param == string("fr_min_quality"))
+            {
+                config.fr_min_quality = stof(value);
+                printf("(VMS config) min face quality to embed = %.2f\n", config.fr_min_quality);
+            }
+            else if (param == string("fr_index"))
+            {
+                config.fr_index = stoi(value);
+                printf("(VMS config) HNSW gallery index = %s\n", config.fr_index ? "on" : "off");
+            }
+            else if (param == string("fr_index_m"))
+            {
+                config.fr_index_m = std::max(stoi(value), 2);
+                printf("(VMS config) HNSW links per node = %d\n", config.fr_index_m);
+            }
+            else if (param == string("fr_index_ef"))
+            {
+                config.fr_index_ef = std::max(stoi(value), 1);
+                printf("(VMS config) HNSW efSearch = %d\n", config.fr_index_ef);
+            }
+            else if (param == string("fr_int8"))
+            {
+                config.fr_int8 = stoi(value);
+                printf("(VMS config) int8 gallery scan = %s\n", config.fr_int8 ? "on" : "off");
+            }
+            else if (param == string("fr_gallery"))
+            {
+                config.fr_gallery = value;
+                printf("(VMS config) gallery file = %s\n", config.fr_gallery.c_str());
+            }
+            else if (param == string("fr_cold_interval"))
+            {
+                config.fr_cold_interval = std::max(stoi(value), 1);
+                printf("(VMS config) full gallery search per track every %d frames on watchlist misses\n",
+                       config.fr_cold_interval);
+            }
+            else if (param == string("inf_precision"))
+            {
+                config.inf_precision = value;
+                printf("(VMS config) inference precision = %s\n", value.c_str());
+                if (value != "fp32" && value != "int8")
+                {
+                    printf("invalid inference precision in vms config file, use fp32 or int8.\n");
+                    exit(0);
+                }
+            }
             else if (param == string("model_name"))
             {
                 VideoInputSource_s vis = {VIDEO_FROM_USBCAM, value};
@@ -92,6 +189,86 @@ void ReadVmsConfigFromFile(const char *cfg_path, VmsCfg &config)
                 config.inf_iou = stof(value);
                 // printf("(VMS config) IOU = %.2f \n", config.inf_iou);
             }
+            else if (param == string("inf_threads"))
+            {
+                config.inf_threads = stoi(value);
+                printf("(VMS config) inference threads = %d\n", config.inf_threads);
+            }
+            else if (param == string("inf_sessions"))
+            {
+                config.inf_sessions = stoi(value);
+                printf("(VMS config) inference sessions per model = %d\n", config.inf_sessions);
+                if (config.inf_sessions <= 0)
+                {
+                    printf("invalid num of inference sessions in vms config file, please check.\n");
+                    exit(0);
+                }
+            }
+            else if (param == string("inf_batch_size"))
+            {
+                config.inf_batch_size = stoi(value);
+                printf("(VMS config) inference batch size = %d\n", config.inf_batch_size);
+                if (config.inf_batch_size <= 0)
+                {
+                    printf("invalid inference batch size in vms config file, please check.\n");
+                    exit(0);
+                }
+            }
+            else if (param == string("inf_batch_timeout_ms"))
+            {
+                config.inf_batch_timeout_ms = stof(value);
+                printf("(VMS config) inference batch timeout = %.1f ms\n", config.inf_batch_timeout_ms);
+            }
+            else if (param == string("inf_async"))
+            {
+                config.inf_async = stoi(value);
+                printf("(VMS config) pipelined inference = %s\n", config.inf_async ? "on" : "off");
+            }
+            else if (param == string("track"))
+            {
+                config.track = stoi(value);
+                printf("(VMS config) face tracking = %s\n", config.track ? "on" : "off");
+            }
+            else if (param == string("track_interval"))
+            {
+                config.track_interval = stoi(value);
+                printf("(VMS config) detector interval with tracking = %d frames\n", config.track_interval);
+                if (config.track_interval < 1)
+                {
+                    printf("(VMS config) track_interval must be at least 1, using 1\n");
+                    config.track_interval = 1;
+                }
+            }
+            else if (param == string("motion_gate"))
+            {
+                config.motion_gate = stoi(value);
+                printf("(VMS config) motion-gated detection = %s\n", config.motion_gate ? "on" : "off");
+            }
+            else if (param == string("motion_heartbeat"))
+            {
+                config.motion_heartbeat = stoi(value);
+                printf("(VMS config) detector heartbeat on static scenes = %d frames\n", config.motion_heartbeat);
+                if (config.motion_heartbeat < 1)
+                {
+                    printf("(VMS config) motion_heartbeat must be at least 1, using 1\n");
+                    config.motion_heartbeat = 1;
+                }
+            }
+            else if (param == string("motion_threshold"))
+            {
+                config.motion_threshold = stoi(value);
+                printf("(VMS config) motion pixel threshold = %d\n", config.motion_threshold);
+            }
+            else if (param == string("ort_cache"))
+            {
+                config.ort_cache = stoi(value);
+                printf("(VMS config) optimized model cache = %s\n", config.ort_cache ? "on" : "off");
+            }
+            else if (param == string("ort_cache_dir"))
+            {
+                config.ort_cache_dir = value;
+                printf("(VMS config) optimized model cache dir = %s\n", config.ort_cache_dir.c_str());
+            }
             if (param == string("screen_idx"))
             {
                 config.screen_idx = stoi(value);
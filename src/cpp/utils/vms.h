@@ -17,7 +17,32 @@ typedef struct
     std::vector<int> group_id;
     float inf_confidence;
     float inf_iou;
+    int inf_threads;  // global ORT intra-op pool size, 0 = all hardware threads
+    int inf_sessions; // shared sessions per model
+    int inf_batch_size;          // max detector inputs batched across channels, 1 = no batching
+    float inf_batch_timeout_ms;  // max time an input waits for its batch to fill
+    int inf_async;               // pipeline capture/pre-process, inference and post-process per channel
+    int ort_cache;               // reuse optimized .ort models across restarts
+    std::string ort_cache_dir;   // where the optimized models are written
     std::string dfp_file;
+    std::string dfp_int8_file; // statically quantized (QDQ) detector produced by face_calibrate
+    std::string inf_precision; // "fp32" or "int8"
+    std::string dfp_raw_file;  // headless detector exporting the raw stride-8/16/32 heads
+    std::string inf_decode;    // "post" (in-graph post-process) or "raw" (decode the heads on the CPU)
+    std::string facenet_file;  // face embedding model, empty = detection only
+    float fr_threshold;        // min cosine similarity to assign an identity
+    float fr_min_quality;      // min face quality (0-1) for a face to be embedded
+    int fr_index;              // search large face databases through an HNSW index
+    int fr_index_m;            // HNSW links per node
+    int fr_index_ef;           // HNSW candidates visited per search
+    int fr_int8;               // scan an int8 copy of the face database, re-ranking in float
+    std::string fr_gallery;    // gallery file to open, enrollments logged next to it; empty = in memory
+    int track;                 // track faces across frames, caching identities per track
+    int track_interval;        // with tracking, run the detector every Nth frame
+    int fr_cold_interval;      // with a watchlist, search the full gallery for a track every Nth frame at most
+    int motion_gate;           // skip the detector while the scene is static and no face is in view
+    int motion_heartbeat;      // with the motion gate, still run the detector every Nth frame
+    int motion_threshold;      // min luma change (0-255) of a downscaled pixel to count as motion
     std::string logo_file;
     std::string model_name;
     std::vector<VideoInputSource_s> video_inputs;
@@ -104,55 +104,6 @@ float intersection_over_union(BBox &bbox_0, BBox &bbox_1, int class_chk)
     return intersection_area / union_area;
 }
 
-void non_maximum_suppression(std::queue<BBox> &bboxes, BBox &bbox, float iou)
-{
-    BBox bbox_0;
-    BBox bbox_to_be_stored;
-    int count = bboxes.size();
-
-    int exit_flag = 0;
-
-    // iterative over all bounding boxes
-    for (int i = 0; i < count; ++i)
-    {
-        bbox_0 = bboxes.front();
-        bboxes.pop();
-        if (intersection_over_union(bbox_0, bbox, 0) > iou)
-        {
-            // if two bounding boxes are highly overlapped, keep the one with higher score
-            if (bbox_0.class_score > bbox.class_score)
-            {
-                bbox_to_be_stored = bbox_0;
-                exit_flag = 1;
-            }
-            else
-            {
-                bbox_to_be_stored = bbox;
-            }
-            if (exit_flag)
-            {
-                bboxes.push(bbox_to_be_stored);
-                return;
-            }
-            else
-            {
-                if (i == count - 1)
-                { // end of comparison
-                    bboxes.push(bbox_to_be_stored);
-                    return;
-                }
-            }
-        }
-        else
-        {
-            // otherwise, put it back to list
-            bboxes.push(bbox_0);
-        }
-    }
-    // if not return from loop, we then add the given bounding box to list
-    bboxes.push(bbox);
-}
-
 void _draw_bbox(cv::Mat &image, int x_min, int y_min, int x_max, int y_max,
                 cv::Scalar box_color, cv::Scalar text_color, const char *class_name)
 {
@@ -79,20 +79,6 @@ struct YOLOv8result
  */
 float intersection_over_union(BBox &bbox_0, BBox &bbox_1, int class_chk);
 
-/**
- * @brief Post-process to calculate detection overlaps to combine the same
- * object with duplicated detections together as only one detection. Bounding
- * box will be added to list if IOU is smaller then given threshold, otherwise
- * the bounding box with higher score will be kept.
- *
- * @param bboxes_detected   linked-list which stores bounding boxes detected
- * @param bbox              bounding box to be added to list
- * @param iou               IOU threshold to combine bounding box
- *
- * @return none
- */
-void non_maximum_suppression(std::queue<BBox> &bboxes, BBox &bbox, float iou);
-
 void _draw_bbox(cv::Mat &image, int x_min, int y_min, int x_max, int y_max,
                 cv::Scalar box_color, cv::Scalar text_color, const char *class_name);
 
@@ -191,7 +191,7 @@ void YOLOv8::DrawResult(YOLOv8Result &result, cv::Mat &image)
     return;
 }
 
-void YOLOv8::GetDetection(std::queue<BBox> &bboxes, int layer_id, float *confidence_cell_buf,
+void YOLOv8::GetDetection(int layer_id, float *confidence_cell_buf,
                           float *coordinate_cell_buf, int row, int col, float *confs_tmp)
 {
     // process confidence score
@@ -268,9 +268,8 @@ void YOLOv8::GetDetection(std::queue<BBox> &bboxes, int layer_id, float *confide
     float max_x = mxutil_min(center_x + 0.5 * w, accl_input_width_);
     float max_y = mxutil_min(center_y + 0.5 * h, accl_input_height_);
 
-    BBox bbox(best_label, best_label_score, min_x, min_y, max_x, max_y);
-
-    non_maximum_suppression(bboxes, bbox, iou_thresh_);
+    candidates_.emplace_back(best_label, best_label_score, min_x, min_y, max_x, max_y);
+    nms_.Add(min_x, min_y, max_x, max_y, best_label_score, best_label);
 }
 
 void YOLOv8::PostProcess(std::vector<float *> output_buffers, YOLOv8Result &result)
@@ -286,6 +285,8 @@ void YOLOv8::PostProcess(std::vector<float *> output_buffers, YOLOv8Result &resu
     }
 
     float *confs_tmp = new float[class_count_];
+    candidates_.clear();
+    nms_.Reset();
 
     for (size_t layer_id = 0; layer_id < kNumPostProcessLayers; ++layer_id)
     {
@@ -313,12 +314,19 @@ void YOLOv8::PostProcess(std::vector<float *> output_buffers, YOLOv8Result &resu
             {
                 float *confidence_cell_buf = confidence_row_buf + col * class_count_;
                 float *coordinate_cell_buf = coordinate_row_buf + col * layer.coordinate_fmap_size;
-                GetDetection(result.bboxes, layer_id, confidence_cell_buf, coordinate_cell_buf, row, col, confs_tmp);
+                GetDetection(layer_id, confidence_cell_buf, coordinate_cell_buf, row, col, confs_tmp);
             }
         }
     }
 
     delete [] confs_tmp;
+
+    // One batched pass over every class instead of merging each box into the queue as it is found
+    size_t num_kept = nms_.Run(iou_thresh_, true, kMaxDetections);
+    for (size_t k = 0; k < num_kept; ++k)
+    {
+        result.bboxes.push(candidates_[nms_.Kept()[k]]);
+    }
 }
 
 void YOLOv8::CalculateBboxParams(const float *feature_values, int layer_id, int row, int col,
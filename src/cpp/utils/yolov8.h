@@ -1,6 +1,7 @@
 #pragma once
 
 #include "yolo_core.h"
+#include "nms.h"
 #include <queue>
 #include <opencv2/opencv.hpp>    /* imshow */
 #include <opencv2/imgproc.hpp>   /* cvtcolor */
@@ -68,8 +69,8 @@ private:
     void Init(size_t accl_input_width, size_t accl_input_height, size_t accl_input_channel,
               float confidence_thresh, float iou_thresh, size_t class_count, const char **class_labels);
 
-    /** @brief Helper methods for building detections from model output. */
-    void GetDetection(std::queue<BBox> &bounding_boxes, int layer_id, float *confidence_buffer,
+    /** @brief Helper methods for building NMS candidates from model output. */
+    void GetDetection(int layer_id, float *confidence_buffer,
                         float *coordinate_buffer, int row, int col, float *confs_tmp);
 
     /** @brief Helper methods for calculating bounding box parameters from feature values. */
@@ -96,6 +97,12 @@ private:
     float confidence_thresh_;
     float iou_thresh_;
 
+    // Class-aware NMS over all candidates of a frame, capped like the reference post-process
+    static constexpr size_t kMaxNmsCandidates = 1024;
+    static constexpr size_t kMaxDetections = 300;
+    NmsEngine nms_{kMaxNmsCandidates};
+    std::vector<BBox> candidates_;
+
     // Letterbox ratio and padding.
     float letterbox_ratio_;
     int letterbox_width_;